@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# host/build.sh
+#
+# Builds the host programs of the driver into host/out:
+#   host/build.sh <project dir> [target...]
+# Project dir holds fonts.h, fonts.c, buffer.h and buffer.cpp of the firmware. Targets are listed below,
+# no target builds all of them. CXX and CXXFLAGS come from the environment.
+#   bench    micro-benchmark of the drawing primitives, see ssd1306_bench.cpp
+#   bench_tiled  the same benchmark in tiled mode, for comparing its frame time and RAM with bench
+#   test     tests of the driver and the widget scene against the emulated controller under ASan and UBSan, see ssd1306_test.cpp
+#   queue_test  stress test of the command queue with threads under TSan, see ssd1306_queue_test.cpp
+
+set -e
+
+if [ $# -lt 1 ] || [ ! -f "$1/fonts.h" ]; then
+	echo "Usage: $0 <dir of fonts.h, fonts.c, buffer.h, buffer.cpp> [target...]" >&2
+	exit 1
+fi
+
+HOST=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$HOST")
+PROJECT=$(cd "$1" && pwd)
+OUT="$HOST/out"
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2 -Wall}
+shift
+TARGETS=${*:-bench bench_tiled test queue_test}
+
+mkdir -p "$OUT"
+INCLUDES="-I$HOST -I$ROOT -I$PROJECT"
+DRIVER="$ROOT/ssd_1306.cpp $ROOT/ssd_1306_transport.cpp $HOST/stm32f0xx_hal.cpp $HOST/ssd1306_emulator.cpp"
+SUPPORT="-x c++ $PROJECT/fonts.c -x none $PROJECT/buffer.cpp"
+
+# Page-oriented copies of the project fonts for the benchmark
+page_fonts() {
+	$CXX $CXXFLAGS -I$ROOT -I$PROJECT "$ROOT/tools/ssd1306_fontconv.cpp" -x c++ "$PROJECT/fonts.c" -x none -o "$OUT/ssd1306_fontconv"
+	"$OUT/ssd1306_fontconv" "$OUT/page_fonts"
+}
+
+for target in $TARGETS; do
+	echo "Building $target"
+	case $target in
+		bench)
+			page_fonts
+			$CXX $CXXFLAGS $INCLUDES -I"$OUT" "$HOST/ssd1306_bench.cpp" "$OUT/page_fonts.cpp" $DRIVER $SUPPORT -o "$OUT/ssd1306_bench"
+		;;
+		bench_tiled)
+			page_fonts
+			$CXX $CXXFLAGS -DSSD1306_TILED=1 $INCLUDES -I"$OUT" "$HOST/ssd1306_bench.cpp" "$OUT/page_fonts.cpp" $DRIVER $SUPPORT \
+				-o "$OUT/ssd1306_bench_tiled"
+		;;
+		test)
+			$CXX $CXXFLAGS -g -fsanitize=address,undefined -fno-sanitize-recover=all $INCLUDES "$HOST/ssd1306_test.cpp" $DRIVER "$ROOT/ssd_1306_bus.cpp" \
+				"$ROOT/ssd_1306_widgets.cpp" $SUPPORT -o "$OUT/ssd1306_test"
+		;;
+		queue_test)
+			$CXX $CXXFLAGS -g -fsanitize=thread -pthread $INCLUDES "$HOST/ssd1306_queue_test.cpp" $DRIVER "$ROOT/ssd_1306_queue.cpp" \
+				$SUPPORT -o "$OUT/ssd1306_queue_test"
+		;;
+		*)
+			echo "Unknown target $target" >&2
+			exit 1
+		;;
+	esac
+done
@@ -0,0 +1,413 @@
+/*
+ * ssd1306_bench.cpp
+ *
+ * Micro-benchmark of the drawing primitives and the text paths on a Linux host. Build it with optimization
+ * like the firmware by host/build.sh <project dir> bench and run host/out/ssd1306_bench [ms per case]. Results go to stdout as CSV, one line per primitive, font and workload:
+ * ns per call, lit pixels per call and millions of lit pixels per second. Workloads are generated from a fixed seed,
+ * so the results of two builds can be compared line by line. Random workloads cover the whole screen and beyond
+ * its edges, worst-case ones are the longest paths of the primitive (full-screen shapes, rows not aligned to pages).
+ * The frame case draws a fixed dashboard scene and sends it by update_screen(), so the frame buffer build and
+ * the tiled one (bench_tiled target, SSD1306_TILED) can be compared by frame time and by the RAM of SSD1306_oled.
+ * In tiled mode drawing calls are only recorded, so the per-primitive cases are skipped there. The _page text cases
+ * draw the same glyphs from PageFontDef tables, which build.sh generates by tools/ssd1306_fontconv.cpp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+#include "ssd1306_mock.h"
+#include "page_fonts.h"
+
+static const uint16_t OPS_COUNT = 256;                   // Calls of one workload
+static const uint8_t FRAMES_COUNT = 16;                  // Frames between clock reads of the frame case
+static const uint8_t TEXT_SIZE = 24;
+static const uint8_t IMAGE_WIDTH = 32;                   // |
+static const uint8_t IMAGE_HEIGHT = 24;                  // | Bitmap of the draw_bitmap cases, 3 pages
+static const int16_t WIDTH = SSD1306_WIDTH;
+static const int16_t HEIGHT = SSD1306_HEIGHT;
+
+struct Op
+{
+	int16_t m_Args[6];
+	char m_Text[TEXT_SIZE];
+};
+
+struct Case
+{
+	const char *m_pPrimitive;
+	const char *m_pWorkload;
+	bool m_Text;                                            // Case is run for every font
+	void (*m_pMake)(Op &Call, const FontDef &Font);
+	void (*m_pDraw)(SSD1306_oled &Display, const Op &Call, const FontDef &Font);
+};
+
+struct FontToRun
+{
+	const FontDef *m_pFont;
+	const PageFontDef *m_pPageFont;                         // Same glyphs converted by tools/ssd1306_fontconv.cpp
+	const char *m_pName;
+};
+
+#if !SSD1306_TILED
+static uint32_t Seed;
+static uint8_t Image[IMAGE_WIDTH * IMAGE_HEIGHT / 8];
+
+// Own generator, so the workloads don't depend on the C library
+static int16_t next_random(int16_t min, int16_t max)
+{
+	Seed = Seed * 1664525 + 1013904223;
+	return min + (int16_t)((Seed >> 8) % (uint32_t)(max - min + 1));
+}
+
+static void make_line(Op &Call, const FontDef &)
+{
+	for(uint8_t i = 0; i < 4; i += 2)
+	{
+		Call.m_Args[i] = next_random(-WIDTH / 4, WIDTH + WIDTH / 4);
+		Call.m_Args[i + 1] = next_random(-HEIGHT / 4, HEIGHT + HEIGHT / 4);
+	}
+}
+
+static void make_line_worst(Op &Call, const FontDef &)
+{
+	bool bFlip = next_random(0, 1);
+	Call.m_Args[0] = 0;
+	Call.m_Args[1] = bFlip ? HEIGHT - 1 : 0;
+	Call.m_Args[2] = WIDTH - 1;
+	Call.m_Args[3] = bFlip ? 0 : HEIGHT - 1;
+}
+
+static void make_circle(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = next_random(-8, WIDTH + 8);
+	Call.m_Args[1] = next_random(-8, HEIGHT + 8);
+	Call.m_Args[2] = next_random(1, HEIGHT / 2);
+}
+
+static void make_circle_worst(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = WIDTH / 2;
+	Call.m_Args[1] = HEIGHT / 2;
+	Call.m_Args[2] = WIDTH / 2;                             // Screen is inside, every octant step is clipped or drawn
+}
+
+static void make_triangle(Op &Call, const FontDef &)
+{
+	for(uint8_t i = 0; i < 6; i += 2)
+	{
+		Call.m_Args[i] = next_random(-WIDTH / 4, WIDTH + WIDTH / 4);
+		Call.m_Args[i + 1] = next_random(-HEIGHT / 4, HEIGHT + HEIGHT / 4);
+	}
+}
+
+static void make_triangle_worst(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = 0;
+	Call.m_Args[1] = 0;
+	Call.m_Args[2] = WIDTH - 1;
+	Call.m_Args[3] = next_random(0, HEIGHT - 1);
+	Call.m_Args[4] = 0;
+	Call.m_Args[5] = HEIGHT - 1;
+}
+
+static void make_vertical_line(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = next_random(0, WIDTH - 1);
+	Call.m_Args[1] = next_random(-8, HEIGHT - 1);
+	Call.m_Args[2] = next_random(1, HEIGHT);
+}
+
+static void make_vertical_line_worst(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = next_random(0, WIDTH - 1);
+	Call.m_Args[1] = 3;                                     // Partial pages at both ends
+	Call.m_Args[2] = HEIGHT - 6;
+}
+
+static void make_char(Op &Call, const FontDef &Font)
+{
+	Call.m_Args[0] = next_random(0, WIDTH - Font.m_Width);
+	Call.m_Args[1] = next_random(0, HEIGHT - Font.m_Height);
+	Call.m_Text[0] = (char)next_random(' ', '~');
+}
+
+static void make_char_worst(Op &Call, const FontDef &Font)
+{
+	Call.m_Args[0] = next_random(0, WIDTH - Font.m_Width);
+	Call.m_Args[1] = 3;                                     // Glyph rows go across page boundaries
+	Call.m_Text[0] = '@';
+}
+
+static void make_string(Op &Call, const FontDef &Font)
+{
+	uint8_t length = next_random(1, TEXT_SIZE - 1);
+	Call.m_Args[0] = next_random(-Font.m_Width, WIDTH - 1);
+	Call.m_Args[1] = next_random(0, HEIGHT - Font.m_Height);
+	for(uint8_t i = 0; i < length; ++i)
+		Call.m_Text[i] = (char)next_random(' ', '~');
+	Call.m_Text[length] = 0;
+}
+
+static void make_string_worst(Op &Call, const FontDef &Font)
+{
+	uint8_t length = WIDTH / Font.m_Width;                  // Whole row of the densest glyph
+	if(length > TEXT_SIZE - 1)
+		length = TEXT_SIZE - 1;
+	Call.m_Args[0] = 0;
+	Call.m_Args[1] = 3;
+	memset(Call.m_Text, '@', length);
+	Call.m_Text[length] = 0;
+}
+
+static const FontToRun FONTS[] = {{&Font_7x10, &PageFont_7x10, "7x10"}, {&Font_11x18, &PageFont_11x18, "11x18"},
+                                  {&Font_16x26, &PageFont_16x26, "16x26"}};
+static const uint8_t FONTS_COUNT = sizeof(FONTS) / sizeof(FONTS[0]);
+
+// Page-oriented copy of the font, so the same workloads run for both glyph formats
+static const PageFontDef &page_font(const FontDef &Font)
+{
+	for(uint8_t font = 0; font < FONTS_COUNT; ++font)
+		if(FONTS[font].m_pFont == &Font)
+			return *FONTS[font].m_pPageFont;
+
+	return *FONTS[0].m_pPageFont;
+}
+
+// Rows aligned to pages, the image bytes are combined with the buffer bytes one to one
+static void make_bitmap_aligned(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = next_random(-IMAGE_WIDTH / 2, WIDTH - IMAGE_WIDTH / 2);
+	Call.m_Args[1] = next_random(0, (HEIGHT - IMAGE_HEIGHT) / 8) * 8;
+}
+
+// Rows not aligned to pages, every image byte is shifted into two buffer bytes
+static void make_bitmap_unaligned(Op &Call, const FontDef &)
+{
+	Call.m_Args[0] = next_random(-IMAGE_WIDTH / 2, WIDTH - IMAGE_WIDTH / 2);
+	Call.m_Args[1] = next_random(0, (HEIGHT - IMAGE_HEIGHT) / 8 - 1) * 8 + next_random(1, 7);
+}
+
+static void draw_line(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_line(Call.m_Args[0], Call.m_Args[1], Call.m_Args[2], Call.m_Args[3]);
+}
+
+static void draw_circle(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_circle(Call.m_Args[0], Call.m_Args[1], Call.m_Args[2]);
+}
+
+static void draw_fill_circle(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_fill_circle(Call.m_Args[0], Call.m_Args[1], Call.m_Args[2]);
+}
+
+static void draw_fill_triangle(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_fill_triangle(Call.m_Args[0], Call.m_Args[1], Call.m_Args[2], Call.m_Args[3], Call.m_Args[4], Call.m_Args[5]);
+}
+
+static void draw_vertical_line(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_vertical_line(Call.m_Args[0], Call.m_Args[1], Call.m_Args[2]);
+}
+
+static void draw_bitmap(SSD1306_oled &Display, const Op &Call, const FontDef &)
+{
+	Display.draw_bitmap(Call.m_Args[0], Call.m_Args[1], IMAGE_WIDTH, IMAGE_HEIGHT, Image, _ROP_COPY);
+}
+
+static void write_char(SSD1306_oled &Display, const Op &Call, const FontDef &Font)
+{
+	Display.set_cursor(Call.m_Args[0], Call.m_Args[1]);
+	Display.write_char(Call.m_Text[0], Font);
+}
+
+static void write_string(SSD1306_oled &Display, const Op &Call, const FontDef &Font)
+{
+	Display.set_cursor(Call.m_Args[0], Call.m_Args[1]);
+	Display.write_string(Call.m_Text, Font);
+}
+
+static void write_char_page(SSD1306_oled &Display, const Op &Call, const FontDef &Font)
+{
+	Display.set_cursor(Call.m_Args[0], Call.m_Args[1]);
+	Display.write_char(Call.m_Text[0], page_font(Font));
+}
+
+static void write_string_page(SSD1306_oled &Display, const Op &Call, const FontDef &Font)
+{
+	Display.set_cursor(Call.m_Args[0], Call.m_Args[1]);
+	Display.write_string(Call.m_Text, page_font(Font));
+}
+
+static const Case CASES[] =
+{
+	{"draw_line", "random", false, make_line, draw_line},
+	{"draw_line", "worst", false, make_line_worst, draw_line},
+	{"draw_circle", "random", false, make_circle, draw_circle},
+	{"draw_circle", "worst", false, make_circle_worst, draw_circle},
+	{"draw_fill_circle", "random", false, make_circle, draw_fill_circle},
+	{"draw_fill_circle", "worst", false, make_circle_worst, draw_fill_circle},
+	{"draw_fill_triangle", "random", false, make_triangle, draw_fill_triangle},
+	{"draw_fill_triangle", "worst", false, make_triangle_worst, draw_fill_triangle},
+	{"draw_vertical_line", "random", false, make_vertical_line, draw_vertical_line},
+	{"draw_vertical_line", "worst", false, make_vertical_line_worst, draw_vertical_line},
+	{"draw_bitmap", "aligned", false, make_bitmap_aligned, draw_bitmap},
+	{"draw_bitmap", "unaligned", false, make_bitmap_unaligned, draw_bitmap},
+	{"write_char", "random", true, make_char, write_char},
+	{"write_char", "worst", true, make_char_worst, write_char},
+	{"write_string", "random", true, make_string, write_string},
+	{"write_string", "worst", true, make_string_worst, write_string},
+	{"write_char_page", "random", true, make_char, write_char_page},
+	{"write_char_page", "worst", true, make_char_worst, write_char_page},
+	{"write_string_page", "random", true, make_string, write_string_page},
+	{"write_string_page", "worst", true, make_string_worst, write_string_page},
+};
+static const uint8_t CASES_COUNT = sizeof(CASES) / sizeof(CASES[0]);
+
+
+// Lit pixels of every call on the clear screen, counted in the frame sent to the mock
+static uint32_t count_pixels(SSD1306_oled &Display, SSD1306_mock &Mock, const Case &Run, const Op *pOps, const FontDef &Font)
+{
+	uint32_t pixels = 0;
+
+	for(uint16_t i = 0; i < OPS_COUNT; ++i)
+	{
+		Display.clear_buffer();
+		Run.m_pDraw(Display, pOps[i], Font);
+		Mock.clear();
+		Display.update_screen();
+		for(size_t byte = 0; byte < Mock.m_Data.size(); ++byte)
+			pixels += __builtin_popcount(Mock.m_Data[byte]);
+	}
+
+	return pixels;
+}
+
+static void run_case(SSD1306_oled &Display, SSD1306_mock &Mock, const Case &Run, const FontToRun &Font, uint32_t min_ms)
+{
+	static Op Ops[OPS_COUNT];
+
+	Seed = 12345;
+	memset(Ops, 0, sizeof(Ops));
+	for(uint16_t i = 0; i < OPS_COUNT; ++i)
+		Run.m_pMake(Ops[i], *Font.m_pFont);
+	uint32_t pixels = count_pixels(Display, Mock, Run, Ops, *Font.m_pFont);
+
+	Display.clear_buffer();
+	for(uint16_t i = 0; i < OPS_COUNT; ++i)                  // Warm-up
+		Run.m_pDraw(Display, Ops[i], *Font.m_pFont);
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point beg = Clock::now();
+	double ns = 0;
+	uint32_t rounds = 0;
+	do
+	{
+		for(uint16_t i = 0; i < OPS_COUNT; ++i)
+			Run.m_pDraw(Display, Ops[i], *Font.m_pFont);
+		++rounds;
+		ns = std::chrono::duration<double, std::nano>(Clock::now() - beg).count();
+	}
+	while(ns < min_ms * 1e6);
+
+	double ops = (double)rounds * OPS_COUNT;
+	printf("%s,%s,%s,%.0f,%.1f,%.1f,%.2f\n", Run.m_pPrimitive, Run.m_Text ? Font.m_pName : "-", Run.m_pWorkload, ops, ns / ops,
+	       (double)pixels / OPS_COUNT, pixels * (double)rounds / ns * 1e3);
+}
+
+#endif
+
+// Dashboard-like frame: a frame, a gauge, a chart line and a few text fields
+static void draw_scene(SSD1306_oled &Display)
+{
+	Display.draw_rectangle(0, 0, WIDTH - 1, HEIGHT - 1);
+	Display.draw_circle(WIDTH - 24, 24, 18);
+	Display.draw_fill_circle(WIDTH - 24, 24, 3);
+	Display.draw_line(WIDTH - 24, 24, WIDTH - 12, 12);
+	Display.draw_fill_rectangle(4, HEIGHT - 12, WIDTH / 2, 8, _DRAW_OR);
+	for(int16_t x = 4; x < WIDTH - 8; x += 8)
+		Display.draw_line(x, HEIGHT - 20 - (x * 7 % 13), x + 8, HEIGHT - 20 - ((x + 8) * 7 % 13));
+	Display.set_cursor(4, 3);
+	Display.write_string("12:34", Font_11x18);
+	Display.set_cursor(4, 24);
+	Display.write_string("T 21.5C", Font_7x10);
+}
+
+// Whole frame from the clear buffer to the bytes sent, the way the firmware redraws
+static void run_frame(SSD1306_oled &Display, SSD1306_mock &Mock, uint32_t min_ms)
+{
+	Display.clear_buffer();
+	draw_scene(Display);
+	Mock.clear();
+	Display.update_screen();
+	uint32_t pixels = 0;
+	for(size_t byte = 0; byte < Mock.m_Data.size(); ++byte)
+		pixels += __builtin_popcount(Mock.m_Data[byte]);
+#if SSD1306_TILED
+	if(Display.display_list_overflow())
+		fprintf(stderr, "Display list overflow, increase SSD1306_DISPLAY_LIST_SIZE\n");
+#endif
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point beg = Clock::now();
+	double ns = 0;
+	uint32_t rounds = 0;
+	do
+	{
+		for(uint8_t i = 0; i < FRAMES_COUNT; ++i)
+		{
+			Display.clear_buffer();
+			draw_scene(Display);
+			Mock.clear();
+			Display.update_screen();
+		}
+		++rounds;
+		ns = std::chrono::duration<double, std::nano>(Clock::now() - beg).count();
+	}
+	while(ns < min_ms * 1e6);
+
+	double frames = (double)rounds * FRAMES_COUNT;
+	printf("frame,-,%s,%.0f,%.1f,%.1f,%.2f\n", SSD1306_TILED ? "scene_tiled" : "scene", frames, ns / frames, (double)pixels,
+	       pixels * frames / ns * 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t min_ms = argc > 1 ? strtoul(argv[1], 0, 10) : 200;
+	if(argc > 2 || !min_ms)
+	{
+		fprintf(stderr, "Usage: %s [ms per case]\n", argv[0]);
+		return 1;
+	}
+
+	SSD1306_mock Mock;
+	SSD1306_oled Display(Mock);
+	if(!Display.is_initialized())
+	{
+		fprintf(stderr, "Initialization failed\n");
+		return 1;
+	}
+
+	printf("# ssd1306_bench %dx%d, %u ms per case, %s, SSD1306_oled %u bytes\n", WIDTH, HEIGHT, min_ms,
+	       SSD1306_TILED ? "tiled" : "frame buffer", (unsigned)sizeof(SSD1306_oled));
+	printf("primitive,font,workload,calls,ns_per_call,pixels_per_call,mpixels_per_s\n");
+#if !SSD1306_TILED
+	Seed = 54321;
+	for(uint16_t byte = 0; byte < sizeof(Image); ++byte)
+		Image[byte] = (uint8_t)next_random(0, 255);
+	for(uint8_t run = 0; run < CASES_COUNT; ++run)
+	{
+		const Case &Run = CASES[run];
+		for(uint8_t font = 0; font < (Run.m_Text ? FONTS_COUNT : 1); ++font)
+			run_case(Display, Mock, Run, FONTS[font], min_ms);
+	}
+#endif
+	run_frame(Display, Mock, min_ms);
+
+	return 0;
+}
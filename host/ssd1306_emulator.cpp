@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ssd1306_emulator.h"
+
+SSD1306_emulator::SSD1306_emulator()
+	{
+		reset();
+	}
+
+// State after the reset pin or power-up. GDDRAM content is undefined on the controller, here it's cleared
+void SSD1306_emulator::reset()
+{
+	memset(m_Gram, 0, sizeof(m_Gram));
+	m_ArgsCount = m_ArgsLeft = 0;
+	m_Command = 0;
+	m_AddressMode = 2;
+	m_ColBeg = 0;
+	m_ColEnd = COLUMNS - 1;
+	m_PageBeg = 0;
+	m_PageEnd = PAGES - 1;
+	m_Col = m_Page = m_PageModeCol = 0;
+	m_StartLine = 0;
+	m_DisplayOffset = 0;
+	m_Multiplex = ROWS - 1;
+	m_Contrast = 0x7F;
+	m_SegRemap = m_ComReverse = false;
+	m_DisplayOn = m_Inverse = m_EntireOn = false;
+	m_Scrolling = m_RamWhileScrolling = false;
+	m_CommandBytes = m_DataBytes = m_UnknownCommands = 0;
+}
+
+// One transaction: command stream (I2C control byte 0x00, SPI D/C low) or data (0x40, D/C high)
+void SSD1306_emulator::write(bool bData, const uint8_t *pData, uint16_t nSize)
+{
+	for(uint16_t i = 0; i < nSize; ++i)
+	{
+		if(bData)
+			data(pData[i]);
+		else
+			command(pData[i]);
+	}
+}
+
+// Collects the arguments of the waiting command or starts the next one
+void SSD1306_emulator::command(uint8_t byte)
+{
+	++m_CommandBytes;
+	if(m_ArgsLeft)
+	{
+		m_Args[m_ArgsCount++] = byte;
+		if(!--m_ArgsLeft)
+			execute();
+		return;
+	}
+
+	m_Command = byte;
+	m_ArgsCount = 0;
+	switch(byte)
+	{
+		case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+			m_ArgsLeft = 1;
+		break;
+		case 0x21: case 0x22: case 0xA3:
+			m_ArgsLeft = 2;
+		break;
+		case 0x29: case 0x2A:
+			m_ArgsLeft = 5;
+		break;
+		case 0x26: case 0x27:
+			m_ArgsLeft = 6;
+		break;
+		default:
+			execute();
+		break;
+	}
+}
+
+void SSD1306_emulator::execute()
+{
+	uint8_t cmd = m_Command;
+
+	if(cmd <= 0x0F)                                        // Lower nibble of the page addressing column
+	{
+		m_PageModeCol = (m_PageModeCol & 0xF0) | cmd;
+		if(2 == m_AddressMode)
+			m_Col = m_PageModeCol;
+		return;
+	}
+	if(cmd <= 0x1F)                                        // Upper nibble of the page addressing column
+	{
+		m_PageModeCol = ((cmd & 0x07) << 4) | (m_PageModeCol & 0x0F);
+		if(2 == m_AddressMode)
+			m_Col = m_PageModeCol;
+		return;
+	}
+	if(cmd >= 0x40 && cmd <= 0x7F)
+	{
+		m_StartLine = cmd & 0x3F;
+		return;
+	}
+	if(cmd >= 0xB0 && cmd <= 0xB7)                         // Page of the page addressing
+	{
+		if(2 == m_AddressMode)
+			m_Page = cmd & 0x07;
+		return;
+	}
+
+	switch(cmd)
+	{
+		case 0x20:
+			if(m_Args[0] < 3)
+				m_AddressMode = m_Args[0];
+		break;
+		case 0x21:
+			m_ColBeg = m_Args[0] & 0x7F;
+			m_ColEnd = m_Args[1] & 0x7F;
+			m_Col = m_ColBeg;
+		break;
+		case 0x22:
+			m_PageBeg = m_Args[0] & 0x07;
+			m_PageEnd = m_Args[1] & 0x07;
+			m_Page = m_PageBeg;
+		break;
+		case 0x81:
+			m_Contrast = m_Args[0];
+		break;
+		case 0xA8:
+			m_Multiplex = m_Args[0] & 0x3F;
+		break;
+		case 0xD3:
+			m_DisplayOffset = m_Args[0] & 0x3F;
+		break;
+		case 0xA0: case 0xA1:
+			m_SegRemap = cmd & 0x01;
+		break;
+		case 0xC0: case 0xC8:
+			m_ComReverse = 0xC8 == cmd;
+		break;
+		case 0xA4: case 0xA5:
+			m_EntireOn = cmd & 0x01;
+		break;
+		case 0xA6: case 0xA7:
+			m_Inverse = cmd & 0x01;
+		break;
+		case 0xAE: case 0xAF:
+			m_DisplayOn = cmd & 0x01;
+		break;
+		case 0x2E:
+			m_Scrolling = false;
+		break;
+		case 0x2F:
+			m_Scrolling = true;
+		break;
+		case 0x8D: case 0xD5: case 0xD9: case 0xDA: case 0xDB: case 0xA3:
+		case 0x26: case 0x27: case 0x29: case 0x2A: case 0xE3:
+		break;                                                  // Timing, power and scroll setup don't change the picture model
+		default:
+			++m_UnknownCommands;
+		break;
+	}
+}
+
+// Writes the byte at the address pointer and moves the pointer the way the addressing mode does
+void SSD1306_emulator::data(uint8_t byte)
+{
+	++m_DataBytes;
+	if(m_Scrolling)
+		m_RamWhileScrolling = true;
+	m_Gram[m_Page][m_Col] = byte;
+
+	switch(m_AddressMode)
+	{
+		case 0:
+			if(m_Col++ < m_ColEnd)
+				break;
+			m_Col = m_ColBeg;
+			m_Page = m_Page < m_PageEnd ? m_Page + 1 : m_PageBeg;
+		break;
+		case 1:
+			if(m_Page++ < m_PageEnd)
+				break;
+			m_Page = m_PageBeg;
+			m_Col = m_Col < m_ColEnd ? m_Col + 1 : m_ColBeg;
+		break;
+		default:
+			m_Col = m_Col < COLUMNS - 1 ? m_Col + 1 : m_PageModeCol;
+		break;
+	}
+}
+
+// GDDRAM bit of column x (controller column, narrow panels add SSD1306_COLUMN_OFFSET) and row y
+bool SSD1306_emulator::pixel(uint8_t x, uint8_t y) const
+{
+	if(x >= COLUMNS || y >= ROWS)
+		return false;
+
+	return m_Gram[y >> 3][x] >> (y & 7) & 1;
+}
+
+// Pixel which the panel shows at column x and row y: start line, display offset, orientation, inverse and on/off are applied.
+// With the orientation set by the driver the rows and columns match the ones of the drawing calls
+bool SSD1306_emulator::visible_pixel(uint8_t x, uint8_t y) const
+{
+	if(!m_DisplayOn || x >= COLUMNS || y > m_Multiplex)
+		return false;
+	if(m_EntireOn)
+		return true;
+
+	uint8_t col = m_SegRemap ? x : COLUMNS - 1 - x;
+	uint8_t com = m_ComReverse ? y : m_Multiplex - y;
+	uint8_t row = (com + m_StartLine + m_DisplayOffset) % ROWS;
+
+	return pixel(col, row) != m_Inverse;
+}
+
+// Saves the visible picture as plain PBM, handy for looking at a failed comparison
+bool SSD1306_emulator::save_pbm(const char *pFileName, uint8_t width, uint8_t height) const
+{
+	FILE *pFile = fopen(pFileName, "w");
+	if(!pFile)
+		return false;
+
+	fprintf(pFile, "P1\n%u %u\n", width, height);
+	for(uint8_t y = 0; y < height; ++y)
+	{
+		for(uint8_t x = 0; x < width; ++x)
+			fputc(visible_pixel(x, y) ? '1' : '0', pFile);
+		fputc('\n', pFile);
+	}
+
+	return 0 == fclose(pFile);
+}
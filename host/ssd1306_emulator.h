@@ -0,0 +1,70 @@
+/*
+ * ssd1306_emulator.h
+ *
+ * SSD1306 controller model for the host build: decodes the command and data stream into its own GDDRAM
+ * the way the controller does, so what the driver sends can be checked pixel by pixel.
+ */
+
+#ifndef SSD1306_EMULATOR_H_
+#define SSD1306_EMULATOR_H_
+
+#include <stdint.h>
+
+class SSD1306_emulator
+{
+	// ==================================  Static constant private variables ========================================== //
+	static const uint8_t COLUMNS = 128;
+	static const uint8_t PAGES = 8;
+	static const uint8_t ROWS = 64;
+	static const uint8_t MAX_ARGS = 6;
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// ==================================== Others private class members =========================================== //
+	uint8_t m_Command;                                      // Command which waits for its arguments
+	uint8_t m_Args[MAX_ARGS];
+	uint8_t m_ArgsCount;
+	uint8_t m_ArgsLeft;
+	uint8_t m_ColBeg;                                       // |
+	uint8_t m_ColEnd;                                       // |
+	uint8_t m_PageBeg;                                      // |
+	uint8_t m_PageEnd;                                      // | Address window of horizontal and vertical addressing
+	uint8_t m_Col;                                          // |
+	uint8_t m_Page;                                         // | Address pointer
+	uint8_t m_PageModeCol;                                  // Column start of page addressing, the pointer goes back to it at the end of the page
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	void command(uint8_t byte);
+	void execute();
+	void data(uint8_t byte);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	uint8_t m_Gram[PAGES][COLUMNS];
+	uint8_t m_AddressMode;                                  // 0 horizontal, 1 vertical, 2 page addressing
+	uint8_t m_StartLine;
+	uint8_t m_DisplayOffset;
+	uint8_t m_Multiplex;                                    // Multiplex ratio, shown rows - 1
+	uint8_t m_Contrast;
+	bool m_SegRemap;                                        // |
+	bool m_ComReverse;                                      // | Orientation, the driver sets both for the upright picture
+	bool m_DisplayOn;
+	bool m_Inverse;
+	bool m_EntireOn;
+	bool m_Scrolling;
+	bool m_RamWhileScrolling;                               // Data was written while the scroll ran, GDDRAM is corrupted on the panel
+	uint32_t m_CommandBytes;
+	uint32_t m_DataBytes;
+	uint32_t m_UnknownCommands;                             // Command bytes the model doesn't know, usually a lost argument
+
+	// =================================== Public class member functions ========================================== //
+	SSD1306_emulator();
+	void reset();
+	void write(bool bData, const uint8_t *pData, uint16_t nSize);
+	bool pixel(uint8_t x, uint8_t y) const;
+	bool visible_pixel(uint8_t x, uint8_t y) const;
+	bool save_pbm(const char *pFileName, uint8_t width = 128, uint8_t height = 64) const;
+	// ------------------------------------------------------------------------------------------------------------- //
+};
+
+#endif /* SSD1306_EMULATOR_H_ */
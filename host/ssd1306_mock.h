@@ -0,0 +1,77 @@
+/*
+ * ssd1306_mock.h
+ *
+ * Transport which keeps the bus traffic in memory instead of sending it, for running the drawing core on a Linux host:
+ *   g++ -Ihost -I. -I<fonts and buffer dir> test.cpp ssd_1306.cpp ssd_1306_transport.cpp host/stm32f0xx_hal.cpp
+ *       host/ssd1306_emulator.cpp <fonts dir>/fonts.c
+ * with SSD1306_oled Display(Mock) in test.cpp. Asynchronous transfers wait for finish(), which plays the HAL interrupts.
+ * The traffic also goes to the emulator if it's given, for checking the picture instead of the bytes.
+ */
+
+#ifndef SSD1306_MOCK_H_
+#define SSD1306_MOCK_H_
+
+#include <vector>
+
+#include "ssd1306.h"
+#include "ssd1306_emulator.h"
+
+class SSD1306_mock : public SSD1306_transport
+{
+	public:
+	std::vector<uint8_t> m_Commands;                        // All command bytes since the last clear()
+	std::vector<uint8_t> m_Data;                            // All data bytes since the last clear()
+	uint32_t m_Transactions;
+	bool m_Pending;                                         // Asynchronous transaction waits for finish()
+	bool m_Fail;                                            // Transactions fail, e.g. for the error paths
+	SSD1306_emulator *m_pEmulator;                          // Controller which decodes the traffic, may be 0
+
+	SSD1306_mock(SSD1306_emulator *pEmulator = 0):
+			m_Transactions(0), m_Pending(false), m_Fail(false), m_pEmulator(pEmulator)
+		{
+		}
+
+	bool probe() { return !m_Fail; }
+	void set_reset(bool) {}
+	const void *handle() const { return this; }
+
+	HAL_StatusTypeDef write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t)
+	{
+		if(m_Fail)
+			return HAL_ERROR;
+
+		std::vector<uint8_t> &Bytes = bData ? m_Data : m_Commands;
+		Bytes.insert(Bytes.end(), pData, pData + nSize);
+		if(m_pEmulator)
+			m_pEmulator->write(bData, pData, nSize);
+		++m_Transactions;
+		return HAL_OK;
+	}
+
+	HAL_StatusTypeDef write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode)
+	{
+		(void)mode;
+		HAL_StatusTypeDef status = write(bData, pData, nSize, 0);
+		m_Pending = HAL_OK == status;
+		return status;
+	}
+
+	// Completes the asynchronous transactions of Display one by one until its transfer is over
+	void finish(SSD1306_oled &Display)
+	{
+		while(m_Pending)
+		{
+			m_Pending = false;
+			Display.transfer_complete(this);
+		}
+	}
+
+	void clear()
+	{
+		m_Commands.clear();
+		m_Data.clear();
+		m_Transactions = 0;
+	}
+};
+
+#endif /* SSD1306_MOCK_H_ */
@@ -0,0 +1,118 @@
+/*
+ * ssd1306_queue_test.cpp
+ *
+ * Stress test of SSD1306_queue with one std::thread per lane and a render thread. Build it under ThreadSanitizer
+ * by host/build.sh <project dir> queue_test and run host/out/ssd1306_queue_test. Every lane owns its band of rows
+ * and posts each pixel of it once per round, so the frame shows which commands came through; it must match the posts
+ * which were accepted, and the accepted and dropped counts must add up. The exit code is 1 on a mismatch
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+#include "ssd1306_queue.h"
+#include "ssd1306_emulator.h"
+#include "ssd1306_mock.h"
+
+static const uint8_t LANES_COUNT = SSD1306_QUEUE_LANES;
+static const uint8_t LANE_ROWS = SSD1306_HEIGHT / LANES_COUNT;
+static const uint16_t POSTS_COUNT = LANE_ROWS * SSD1306_WIDTH;   // Pixels of the band of one lane
+static const uint8_t ROUNDS_COUNT = 20;
+
+struct Producer
+{
+	uint32_t m_Accepted;
+	uint32_t m_Dropped;
+	bool m_Pixels[SSD1306_HEIGHT][SSD1306_WIDTH];         // Pixels of the accepted posts
+};
+
+static Producer Producers[LANES_COUNT];
+static std::atomic<uint8_t> Running;
+
+static void produce(SSD1306_queue *pQueue, uint8_t lane)
+{
+	Producer &P = Producers[lane];
+
+	for(uint32_t i = 0; i < POSTS_COUNT; ++i)
+	{
+		uint16_t pixel = (i * 7) % POSTS_COUNT;              // Step is coprime with the band size, every pixel comes once
+		int16_t x = pixel % SSD1306_WIDTH, y = lane * LANE_ROWS + pixel / SSD1306_WIDTH;
+		if(pQueue->post_pixel(lane, x, y))
+		{
+			++P.m_Accepted;
+			P.m_Pixels[y][x] = true;
+		}
+		else
+		{
+			++P.m_Dropped;
+			std::this_thread::yield();
+		}
+	}
+	Running.fetch_sub(1);
+}
+
+static void consume(SSD1306_queue *pQueue, uint32_t *pDrawn)
+{
+	while(Running.load())
+		*pDrawn += pQueue->render();
+	*pDrawn += pQueue->render();                             // Posts after the last pass
+}
+
+// One round from the clear screen, returns true if it passed
+static bool run_round(SSD1306_oled &Display, SSD1306_queue &Queue, SSD1306_emulator &Emulator)
+{
+	uint32_t drawn = 0;
+
+	Display.clear_buffer();
+	Display.update_screen();
+	memset(Producers, 0, sizeof(Producers));
+	uint16_t droppedBefore[LANES_COUNT];
+	for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+		droppedBefore[lane] = Queue.dropped(lane);
+
+	Running.store(LANES_COUNT);
+	std::thread Render(consume, &Queue, &drawn);
+	std::thread Lanes[LANES_COUNT];
+	for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+		Lanes[lane] = std::thread(produce, &Queue, lane);
+	for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+		Lanes[lane].join();
+	Render.join();
+
+	bool bPassed = true;
+	uint32_t accepted = 0, dropped = 0;
+	for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+	{
+		const Producer &P = Producers[lane];
+		bPassed &= P.m_Accepted + P.m_Dropped == POSTS_COUNT && (uint16_t)(P.m_Dropped + droppedBefore[lane]) == Queue.dropped(lane);
+		accepted += P.m_Accepted;
+		dropped += P.m_Dropped;
+	}
+	bPassed &= drawn == accepted;
+
+	uint16_t wrong = 0;
+	for(uint8_t y = 0; y < LANES_COUNT * LANE_ROWS; ++y)
+		for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+			wrong += Emulator.pixel(x + SSD1306_COLUMN_OFFSET, y) != Producers[y / LANE_ROWS].m_Pixels[y][x];
+	bPassed &= !wrong;
+	printf("accepted %u, dropped %u, drawn %u, wrong pixels %u\n", accepted, dropped, drawn, wrong);
+
+	return bPassed;
+}
+
+int main()
+{
+	SSD1306_emulator Emulator;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	SSD1306_queue Queue(Display);
+	bool bFailed = false;
+
+	for(uint8_t round = 0; round < ROUNDS_COUNT; ++round)
+		bFailed |= !run_round(Display, Queue, Emulator);
+
+	printf("%s\n", bFailed ? "FAIL" : "ok");
+	return bFailed;
+}
@@ -0,0 +1,846 @@
+/*
+ * ssd1306_test.cpp
+ *
+ * Host tests of the driver against the emulated controller (ssd1306_emulator.h) behind the host HAL.
+ * Build and run them by host/build.sh <project dir> test && host/out/ssd1306_test. Failed checks are printed,
+ * the exit code is the count of failed tests
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "ssd1306.h"
+#include "ssd1306_bus.h"
+#include "ssd1306_emulator.h"
+#include "ssd1306_mock.h"
+#include "ssd1306_widgets.h"
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+static I2C_HandleTypeDef hi2c;
+static SSD1306_oled *pDisplay = 0;                       // Display of the HAL callbacks
+static SSD1306_bus *pBus = 0;                            // Bus of the HAL callbacks
+static bool bFailed;
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	if(pDisplay)
+		pDisplay->transfer_complete(hi2c);
+	if(pBus)
+		pBus->transfer_complete(hi2c);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	if(pDisplay)
+		pDisplay->transfer_error(hi2c);
+	if(pBus)
+		pBus->transfer_error(hi2c);
+}
+
+static void check(bool bCondition, const char *pText, int line)
+{
+	if(bCondition)
+		return;
+
+	printf("  line %d: %s\n", line, pText);
+	bFailed = true;
+}
+
+// Pixels which differ between the GDDRAM of the two controllers
+static uint16_t differ(const SSD1306_emulator &A, const SSD1306_emulator &B)
+{
+	uint16_t count = 0;
+
+	for(uint8_t y = 0; y < SSD1306_HEIGHT; ++y)
+		for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+			count += A.pixel(x + SSD1306_COLUMN_OFFSET, y) != B.pixel(x + SSD1306_COLUMN_OFFSET, y);
+
+	return count;
+}
+
+// Reference picture: the whole buffer sent synchronously to a second controller
+static void reference(SSD1306_emulator &Ref, void (*pDraw)(SSD1306_oled &Display))
+{
+	SSD1306_mock Mock(&Ref);
+	SSD1306_oled Display(Mock);
+	pDraw(Display);
+	Display.update_screen();
+}
+
+static void draw_scene(SSD1306_oled &Display)
+{
+	Display.draw_line(0, 0, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1);
+	Display.draw_fill_rectangle(SSD1306_WIDTH / 6, 5, SSD1306_WIDTH / 4, SSD1306_HEIGHT / 3);
+	Display.draw_circle(SSD1306_WIDTH * 2 / 3, SSD1306_HEIGHT / 2, SSD1306_HEIGHT / 4);
+}
+
+// Lit pixels of the GDDRAM, the only one must be at x, y
+static bool only_pixel(const SSD1306_emulator &Emulator, uint8_t x, uint8_t y)
+{
+	uint16_t count = 0;
+
+	for(uint8_t row = 0; row < SSD1306_HEIGHT; ++row)
+		for(uint8_t col = 0; col < SSD1306_WIDTH; ++col)
+			count += Emulator.pixel(col + SSD1306_COLUMN_OFFSET, row);
+
+	return 1 == count && Emulator.pixel(x + SSD1306_COLUMN_OFFSET, y);
+}
+
+// Zero-length lines on the last row and column, their dirty span used to go one page below the buffer
+static void test_point_lines()
+{
+	static const int16_t POINTS[][2] = {{5, SSD1306_HEIGHT - 1}, {SSD1306_WIDTH - 1, 5}, {SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1}};
+
+	for(uint8_t i = 0; i < sizeof(POINTS) / sizeof(POINTS[0]); ++i)
+	{
+		SSD1306_emulator Emulator;
+		SSD1306_mock Mock(&Emulator);
+		SSD1306_oled Display(Mock);
+		Display.update_screen();
+		Display.draw_line(POINTS[i][0], POINTS[i][1], POINTS[i][0], POINTS[i][1]);
+		Display.update_dirty();
+		CHECK(only_pixel(Emulator, POINTS[i][0], POINTS[i][1]));
+	}
+}
+
+// Circle of radius 0 is its center, the diagonal neighbours are out of its dirty box
+static void test_zero_circle()
+{
+	SSD1306_emulator Emulator;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	Display.draw_circle(20, 20, 0);
+	Display.update_screen();
+	CHECK(only_pixel(Emulator, 20, 20));
+
+	Display.clear_buffer();
+	Display.draw_circle(SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1, 0);
+	Display.update_dirty();
+	CHECK(only_pixel(Emulator, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1));
+}
+
+// Synchronous bus transaction from code which runs with interrupts disabled keeps them disabled
+static void test_bus_primask()
+{
+	SSD1306_emulator Emulator, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	SSD1306_bus Bus(&hi2c);
+	SSD1306_bus_panel Panel(Bus, 0x3C, 0, 0);
+	SSD1306_oled Display(Panel);
+	CHECK(Display.is_initialized());
+
+	draw_scene(Display);
+	__disable_irq();
+	Display.update_screen();
+	CHECK(1 == __get_PRIMASK());
+	__enable_irq();
+	Display.update_screen();
+	CHECK(0 == __get_PRIMASK());
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+}
+
+#if !SSD1306_TILED
+// Commands of a panel which can't get the bus from the asynchronous frame of another panel are kept
+// and go with the next transaction
+static void test_bus_busy_commands()
+{
+	SSD1306_emulator EmulatorA, EmulatorB, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &EmulatorA);
+	HAL_Host_AttachI2C(&hi2c, 0x3D, &EmulatorB);
+	SSD1306_bus Bus(&hi2c);
+	SSD1306_bus_panel PanelA(Bus, 0x3C, 0, 0), PanelB(Bus, 0x3D, 0, 0);
+	SSD1306_oled DisplayA(PanelA), DisplayB(PanelB);
+	pBus = &Bus;
+
+	HAL_Host_AutoInterrupts(false);
+	draw_scene(DisplayA);
+	CHECK(DisplayA.update_dirty_async());
+	CHECK(Bus.is_busy());
+	DisplayB.set_contrast(10);                               // Waits for the bus in vain
+	CHECK(10 != EmulatorB.m_Contrast);
+
+	while(HAL_Host_RunInterrupts())
+		;
+	HAL_Host_AutoInterrupts(true);
+	CHECK(!Bus.is_busy());
+	DisplayB.update_dirty();
+	CHECK(10 == EmulatorB.m_Contrast);
+	reference(Ref, draw_scene);
+	CHECK(!differ(EmulatorA, Ref));
+
+	pBus = 0;
+}
+#endif
+
+// Initialization after a reset of the controller restores the contrast, inverse and display-on state set before
+static void test_reinit_state()
+{
+	SSD1306_emulator Emulator;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.set_contrast(10);
+	Display.set_inverse(true);
+	Display.set_display_on(false);
+
+	for(uint8_t warm = 0; warm < 2; ++warm)
+	{
+		Emulator.reset();
+		CHECK(Display.ssd1306_Init(warm));
+		CHECK(10 == Emulator.m_Contrast);
+		CHECK(Emulator.m_Inverse);
+		CHECK(!Emulator.m_DisplayOn);
+	}
+
+	Display.set_inverse(false);
+	Display.set_display_on(true);
+	Emulator.reset();
+	Display.ssd1306_Init();
+	CHECK(!Emulator.m_Inverse);
+	CHECK(Emulator.m_DisplayOn);
+}
+
+// Updates wait while the controller scrolls, GDDRAM is untouched. After stop_scroll() the whole frame goes again
+static void test_hw_scroll()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	Display.start_scroll(_SCROLL_LEFT, 0, SSD1306_HEIGHT / 8 - 1, _SCROLL_2_FRAMES);
+	CHECK(Display.is_scrolling());
+	CHECK(Emulator.m_Scrolling);
+
+	Mock.clear();
+	draw_scene(Display);
+	Display.update_dirty();
+	CHECK(Mock.m_Data.empty());
+
+	Display.stop_scroll();
+	CHECK(!Emulator.m_Scrolling);
+	memset(Emulator.m_Gram, 0xFF, sizeof(Emulator.m_Gram));  // Scrolled content, only the full frame restores it
+	Mock.clear();
+	Display.update_dirty();
+	CHECK(SSD1306_WIDTH * SSD1306_HEIGHT / 8 == Mock.m_Data.size());
+	CHECK(!Emulator.m_RamWhileScrolling);
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+}
+
+#if SSD1306_HEIGHT == 64
+// Screen pixel at x, y
+static bool shown(const SSD1306_emulator &Emulator, uint8_t x, uint8_t y)
+{
+	return Emulator.visible_pixel(x + SSD1306_COLUMN_OFFSET, y);
+}
+
+// scroll_rows() moves the start line, only the cleared rows coming into view are sent
+static void test_scroll_rows()
+{
+	static const uint8_t ROWS = 8;
+
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	draw_scene(Display);
+	Display.update_screen();
+
+	Mock.clear();
+	Display.scroll_rows(ROWS);
+	Display.update_dirty();
+	CHECK(ROWS == Display.get_start_line());
+	CHECK(ROWS == Emulator.m_StartLine);
+	CHECK(SSD1306_TILED || SSD1306_WIDTH == Mock.m_Data.size());  // One page of new rows, the display list sends all pages
+
+	reference(Ref, draw_scene);
+	uint16_t wrong = 0;
+	for(uint8_t y = 0; y < SSD1306_HEIGHT; ++y)
+		for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+			wrong += shown(Emulator, x, y) != (y < SSD1306_HEIGHT - ROWS && Ref.pixel(x + SSD1306_COLUMN_OFFSET, y + ROWS));
+	CHECK(!wrong);
+
+	Display.scroll_rows(-ROWS);
+	Display.update_dirty();
+	CHECK(0 == Emulator.m_StartLine);
+}
+#endif
+
+#if SSD1306_CONSOLE
+// Console lines which are on the screen after the console test, the first line went up out of view
+static void draw_console(SSD1306_oled &Display)
+{
+	static const char *const LINES[] = {"STUVWX", "L1", "L2", "L3", "L4", "L5"};
+
+	for(uint8_t i = 0; i < sizeof(LINES) / sizeof(LINES[0]); ++i)
+	{
+		Display.set_cursor(0, i * 10);
+		Display.write_string(LINES[i], Font_7x10);
+	}
+}
+
+// Console wraps at the right edge, the line below the bottom scrolls the screen up by the start line
+// and only the pages of the new line are sent
+static void test_console()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.set_font(_7x10);
+	Display.set_console(true);
+	Display.console_write("ABCDEFGHIJKLMNOPQRSTUVWX\nL1\nL2\nL3\nL4");
+	Display.update_dirty();
+	CHECK(0 == Emulator.m_StartLine);
+
+	Mock.clear();
+	Display.console_write("\nL5");                        // Rows 60...69 go round the buffer, the cleared rows are 0...9
+	Display.update_dirty();
+	CHECK(10 == Display.get_start_line());
+	CHECK(10 == Emulator.m_StartLine);
+	CHECK(Mock.m_Data.size() <= 3 * SSD1306_WIDTH);          // Pages 7, 0 and 1
+
+	reference(Ref, draw_console);
+	uint16_t wrong = 0;
+	for(uint8_t y = 0; y < SSD1306_HEIGHT; ++y)
+		for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+			wrong += shown(Emulator, x, y) != Ref.pixel(x + SSD1306_COLUMN_OFFSET, y);
+	CHECK(!wrong);
+}
+#endif
+
+// Pixel of the page-oriented image, bit 0 of a column byte is the top row of its page
+static bool image_pixel(const uint8_t *pImage, uint8_t width, uint8_t x, uint8_t y)
+{
+	return pImage[(y >> 3) * width + x] >> (y & 7) & 1;
+}
+
+// Every raster op with and without the mask at y which isn't on a page boundary, the picture under the image
+// is the scene. Expected pixels are computed here from the scene on the reference controller
+static void test_raster_ops()
+{
+	static const uint8_t WIDTH = 12, HEIGHT = 12, X = SSD1306_WIDTH / 6 - 4, Y = 13;
+	static const RASTER_OP OPS[] = {_ROP_COPY, _ROP_OR, _ROP_AND, _ROP_XOR, _ROP_INVERT};
+
+	uint8_t Image[2 * WIDTH], Mask[2 * WIDTH];
+	for(uint8_t i = 0; i < sizeof(Image); ++i)
+	{
+		Image[i] = i * 37 + 11;
+		Mask[i] = 0x5A ^ i * 13;
+	}
+
+	SSD1306_emulator Ref;
+	reference(Ref, draw_scene);
+	for(uint8_t op = 0; op < sizeof(OPS) / sizeof(OPS[0]); ++op)
+		for(uint8_t masked = 0; masked < 2; ++masked)
+		{
+			SSD1306_emulator Emulator;
+			SSD1306_mock Mock(&Emulator);
+			SSD1306_oled Display(Mock);
+			draw_scene(Display);
+			Display.update_screen();
+			Display.draw_bitmap(X, Y, WIDTH, HEIGHT, Image, OPS[op], masked ? Mask : 0);
+			Display.update_dirty();
+
+			uint16_t wrong = 0;
+			for(uint8_t y = 0; y < SSD1306_HEIGHT; ++y)
+				for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+				{
+					bool bDst = Ref.pixel(x + SSD1306_COLUMN_OFFSET, y), bExpected = bDst;
+					if(x >= X && x < X + WIDTH && y >= Y && y < Y + HEIGHT &&
+					   (!masked || image_pixel(Mask, WIDTH, x - X, y - Y)))
+					{
+						bool bSrc = image_pixel(Image, WIDTH, x - X, y - Y);
+						switch(OPS[op])
+						{
+							case _ROP_OR:     bExpected = bDst || bSrc; break;
+							case _ROP_AND:    bExpected = bDst && bSrc; break;
+							case _ROP_XOR:    bExpected = bDst != bSrc; break;
+							case _ROP_INVERT: bExpected = !bSrc;        break;
+							default:          bExpected = bSrc;         break;
+						}
+					}
+					wrong += Emulator.pixel(x + SSD1306_COLUMN_OFFSET, y) != bExpected;
+				}
+			CHECK(!wrong);
+		}
+}
+
+// Widgets of the scene tests: two labels in the opposite corners and the bar between them, their damaged
+// rectangles don't touch each other on the screen of any geometry
+static void add_widgets(SSD1306_scene &Scene, int8_t &left, int8_t &bar)
+{
+	left = Scene.add_label(0, 0, Font_7x10, "AB");
+	bar = Scene.add_bar(SSD1306_WIDTH / 2 - 10, 13, 20, 6, 10);
+	Scene.add_label(SSD1306_WIDTH - 14, SSD1306_HEIGHT - 10, Font_7x10, "CD");
+}
+
+// Scene of the widgets in the state at the end of the scene test
+static void draw_widgets(SSD1306_oled &Display)
+{
+	SSD1306_scene Scene(Display);
+	int8_t left, bar;
+	add_widgets(Scene, left, bar);
+	Scene.set_text(left, "ABC");
+	Scene.set_value(bar, 5);
+	Scene.render();
+}
+
+// render() sends every damaged rectangle widened to whole pages and nothing else. Damage of the old and the new
+// bounds of a label is joined into one rectangle. In tiled mode the whole screen is sent
+static void test_scene()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	SSD1306_scene Scene(Display);
+	int8_t left, bar;
+	Display.update_screen();
+
+	Mock.clear();
+	add_widgets(Scene, left, bar);
+	Scene.render();
+	CHECK(SSD1306_TILED || 2 * 14 + 2 * 20 + 2 * 14 == Mock.m_Data.size());
+
+	Mock.clear();
+	Scene.set_text(left, "ABC");                            // Columns 0...13 and 0...20 of pages 0 and 1
+	Scene.render();
+	CHECK(SSD1306_TILED || 2 * 21 == Mock.m_Data.size());
+
+	Mock.clear();
+	Scene.set_value(bar, 5);                                // Rows 13...18 are pages 1 and 2
+	Scene.render();
+	CHECK(SSD1306_TILED || 2 * 20 == Mock.m_Data.size());
+
+	reference(Ref, draw_widgets);
+	CHECK(!differ(Emulator, Ref));
+}
+
+#if !SSD1306_TILED
+// Overlapping copy_region() in both directions, the region moves by dx, dy unchanged
+static void test_copy_region()
+{
+	static const int8_t SHIFTS[][2] = {{4, 6}, {-4, -6}};
+	static const uint8_t SRC_X = 14, SRC_Y = 9, WIDTH = 40, HEIGHT = 20;
+
+	SSD1306_emulator Ref;
+	reference(Ref, draw_scene);
+	for(uint8_t i = 0; i < sizeof(SHIFTS) / sizeof(SHIFTS[0]); ++i)
+	{
+		int8_t dx = SHIFTS[i][0], dy = SHIFTS[i][1];
+		SSD1306_emulator Emulator;
+		SSD1306_mock Mock(&Emulator);
+		SSD1306_oled Display(Mock);
+		draw_scene(Display);
+		Display.update_screen();
+		Display.copy_region(SRC_X, SRC_Y, WIDTH, HEIGHT, SRC_X + dx, SRC_Y + dy);
+		Display.update_dirty();
+
+		uint16_t wrong = 0;
+		for(uint8_t y = 0; y < SSD1306_HEIGHT; ++y)
+			for(uint8_t x = 0; x < SSD1306_WIDTH; ++x)
+			{
+				bool bMoved = x >= SRC_X + dx && x < SRC_X + dx + WIDTH && y >= SRC_Y + dy && y < SRC_Y + dy + HEIGHT;
+				bool bExpected = Ref.pixel(x + SSD1306_COLUMN_OFFSET - (bMoved ? dx : 0), y - (bMoved ? dy : 0));
+				wrong += Emulator.pixel(x + SSD1306_COLUMN_OFFSET, y) != bExpected;
+			}
+		CHECK(!wrong);
+	}
+}
+
+// Animation stream format of draw_frame(), the same as in tools/ssd1306_animenc.cpp
+static const uint8_t FRAME_DELTA = 0x01;
+static const uint8_t FRAME_END = 0xFF;
+static const uint8_t FRAME_RUN_REPEAT = 0x80;
+static const uint16_t FRAME_SIZE = SSD1306_WIDTH * SSD1306_HEIGHT / 8;
+
+static void put_repeat(std::vector<uint8_t> &Stream, uint8_t value, uint16_t count)
+{
+	while(count)
+	{
+		uint8_t run = count > 128 ? 128 : count;
+		Stream.push_back(FRAME_RUN_REPEAT | (run - 1));
+		Stream.push_back(value);
+		count -= run;
+	}
+}
+
+static void put_literal(std::vector<uint8_t> &Stream, const uint8_t *pBytes, uint8_t count)
+{
+	Stream.push_back(count - 1);
+	Stream.insert(Stream.end(), pBytes, pBytes + count);
+}
+
+// GDDRAM bytes which differ from the frame
+static uint16_t differ_bytes(const SSD1306_emulator &Emulator, const uint8_t *pFrame)
+{
+	uint16_t count = 0;
+
+	for(uint16_t offset = 0; offset < FRAME_SIZE; ++offset)
+		count += Emulator.m_Gram[offset / SSD1306_WIDTH][offset % SSD1306_WIDTH + SSD1306_COLUMN_OFFSET] != pFrame[offset];
+
+	return count;
+}
+
+// Key frame replaces the buffer, delta frame is XORed with it and only the bytes which change are sent
+static void test_draw_frame()
+{
+	static const uint16_t AT = SSD1306_WIDTH + 10;           // Page 1, column 10
+	static const uint8_t KEY[] = {0x81, 0x42, 0x24, 0x18}, DELTA[] = {0x00, 0x0F, 0xF0};
+
+	std::vector<uint8_t> Stream;
+	Stream.push_back(0);
+	put_repeat(Stream, 0x00, AT);
+	put_literal(Stream, KEY, sizeof(KEY));
+	put_repeat(Stream, 0xFF, 8);
+	put_repeat(Stream, 0x00, FRAME_SIZE - AT - sizeof(KEY) - 8);
+	uint16_t delta = Stream.size();
+	Stream.push_back(FRAME_DELTA);
+	put_repeat(Stream, 0x00, AT + 1);
+	put_literal(Stream, DELTA, sizeof(DELTA));
+	put_repeat(Stream, 0x00, FRAME_SIZE - AT - 1 - sizeof(DELTA));
+	uint16_t end = Stream.size();
+	Stream.push_back(FRAME_END);
+
+	uint8_t Frame[FRAME_SIZE] = {0};
+	memcpy(Frame + AT, KEY, sizeof(KEY));
+	memset(Frame + AT + sizeof(KEY), 0xFF, 8);
+
+	SSD1306_emulator Emulator;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	draw_scene(Display);
+	Display.update_screen();
+	CHECK(&Stream[delta] == Display.draw_frame(&Stream[0]));
+	Display.update_dirty();
+	CHECK(!differ_bytes(Emulator, Frame));
+
+	for(uint8_t i = 0; i < sizeof(DELTA); ++i)
+		Frame[AT + 1 + i] ^= DELTA[i];
+	Mock.clear();
+	CHECK(&Stream[end] == Display.draw_frame(&Stream[delta]));
+	Display.update_dirty();
+	CHECK(!differ_bytes(Emulator, Frame));
+	CHECK(2 == Mock.m_Data.size());                         // The zero byte of the literal run changes nothing
+	CHECK(!Display.draw_frame(&Stream[end]));
+}
+
+static const int16_t NUMBER_X = 10, NUMBER_Y = 16;      // Page aligned, a char is two pages of 7 columns
+
+static void draw_digits(SSD1306_oled &Display, const char *pText)
+{
+	Display.set_cursor(NUMBER_X, NUMBER_Y);
+	Display.write_string(pText, Font_7x10);
+}
+
+static void draw_12385(SSD1306_oled &Display)
+{
+	draw_digits(Display, "12385");
+}
+
+static void draw_minus_7(SSD1306_oled &Display)
+{
+	draw_digits(Display, "   -7");
+}
+
+// New value of the numeric field redraws and sends only the chars which changed
+static void test_draw_number()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	SSD1306_oled::NumberField Field;
+	Display.update_screen();
+	Display.init_number(Field, NUMBER_X, NUMBER_Y, Font_7x10, 5);
+	Display.draw_number(Field, 12345);
+	Display.update_dirty();
+
+	Mock.clear();
+	Display.draw_number(Field, 12385);
+	Display.update_dirty();
+	CHECK(2 * 7 == Mock.m_Data.size());
+	reference(Ref, draw_12385);
+	CHECK(!differ(Emulator, Ref));
+
+	Mock.clear();
+	Display.draw_number(Field, 12385);
+	Display.update_dirty();
+	CHECK(Mock.m_Data.empty());
+
+	Display.draw_number(Field, -7);                          // Spaces erase the digits which are gone
+	Display.update_dirty();
+	reference(Ref, draw_minus_7);
+	CHECK(!differ(Emulator, Ref));
+}
+
+static uint32_t Callbacks = 0;
+
+static void on_complete(SSD1306_oled &)
+{
+	++Callbacks;
+}
+
+// Rectangle over the bottom rows, on the screen of any geometry
+static void draw_bottom(SSD1306_oled &Display)
+{
+	Display.draw_fill_rectangle(SSD1306_WIDTH / 2 - 4, SSD1306_HEIGHT - 14, SSD1306_WIDTH / 2, 10, _DRAW_XOR);
+}
+
+static void draw_more(SSD1306_oled &Display)
+{
+	draw_scene(Display);
+	draw_bottom(Display);
+}
+
+// Asynchronous frame is sent window by window from the transfer-complete interrupts
+static void test_async_completion()
+{
+	SSD1306_emulator Emulator, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	SSD1306_oled Display(&hi2c, 0x3C, 0, 0);
+	pDisplay = &Display;
+	HAL_Host_AutoInterrupts(false);
+
+	for(uint8_t mode = 0; mode < 2; ++mode)
+	{
+		Display.clear_buffer();
+		Display.update_screen();
+		Display.set_async_transfer(mode ? _IT_TRANSFER : _DMA_TRANSFER);
+		draw_scene(Display);
+		Callbacks = 0;
+		CHECK(Display.update_dirty_async(on_complete));
+		CHECK(Display.is_busy());
+		CHECK(!Display.update_dirty_async());                 // Previous transfer still runs
+		CHECK(HAL_Host_RunInterrupts() > 1);                  // Addressing and data of every window
+		CHECK(!Display.is_busy());
+		CHECK(1 == Callbacks);
+		reference(Ref, draw_scene);
+		CHECK(!differ(Emulator, Ref));
+	}
+
+	HAL_Host_AutoInterrupts(true);
+	pDisplay = 0;
+}
+
+// Drawing goes on while the frame is on the wire, the front buffer keeps the frame which was started
+static void test_async_front_buffer()
+{
+	SSD1306_emulator Emulator, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	SSD1306_oled Display(&hi2c, 0x3C, 0, 0);
+	pDisplay = &Display;
+	HAL_Host_AutoInterrupts(false);
+
+	draw_scene(Display);
+	CHECK(Display.update_screen_async());
+	draw_bottom(Display);
+	HAL_Host_RunInterrupts();
+#if SSD1306_DOUBLE_BUFFER
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+#endif
+	CHECK(Display.update_dirty_async());
+	HAL_Host_RunInterrupts();
+	reference(Ref, draw_more);
+	CHECK(!differ(Emulator, Ref));
+
+	HAL_Host_AutoInterrupts(true);
+	pDisplay = 0;
+}
+
+// Interrupts come while wait() polls, like on the target
+static void test_async_wait()
+{
+	SSD1306_emulator Emulator, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	SSD1306_oled Display(&hi2c, 0x3C, 0, 0);
+	pDisplay = &Display;
+
+	draw_scene(Display);
+	CHECK(Display.update_dirty_async());
+	CHECK(Display.wait());
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+
+	pDisplay = 0;
+}
+
+// NACK of the asynchronous transfer comes to the error callback, the next update sends the whole frame again
+static void test_async_error()
+{
+	SSD1306_emulator Emulator, Ref;
+	HAL_Host_Detach();
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	SSD1306_oled Display(&hi2c, 0x3C, 0, 0);
+	pDisplay = &Display;
+	Display.update_screen();
+
+	HAL_Host_Detach();                                       // Panel doesn't answer
+	HAL_Host_AutoInterrupts(false);
+	draw_scene(Display);
+	CHECK(Display.update_dirty_async());
+	CHECK(Display.is_busy());
+	CHECK(1 == HAL_Host_RunInterrupts());                    // Error of the first window ends the transfer
+	CHECK(!Display.is_busy());
+
+	HAL_Host_AttachI2C(&hi2c, 0x3C, &Emulator);
+	HAL_Host_AutoInterrupts(false);
+	memset(Emulator.m_Gram, 0xFF, sizeof(Emulator.m_Gram));  // GDDRAM is lost, only the full frame restores it
+	CHECK(Display.update_dirty_async());
+	HAL_Host_RunInterrupts();
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+
+	HAL_Host_AutoInterrupts(true);
+	pDisplay = 0;
+}
+
+// Paced asynchronous frame which fails to start stays pending and goes with the next service()
+static void test_paced_async_retry()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	Display.set_frame_rate(30, true);
+
+	draw_scene(Display);
+	Display.update_dirty();
+	Mock.m_Fail = true;
+	CHECK(!Display.service());
+	CHECK(0 == Display.bus_stats().m_FramesSent);
+	Mock.m_Fail = false;
+	CHECK(Display.service());
+	Mock.finish(Display);
+	CHECK(1 == Display.bus_stats().m_FramesSent);
+	reference(Ref, draw_scene);
+	CHECK(!differ(Emulator, Ref));
+}
+
+static void draw_chart(SSD1306_oled &Display)
+{
+	SSD1306_oled::StripChart Chart;
+	Display.init_chart(Chart, 10, 16, 100, 32, 0, 100);
+	for(int16_t i = 0; i < 150; ++i)
+		Display.chart_sample(Chart, i * 37 % 101);
+}
+
+// Chart samples in paced mode are sent by service() with the frame, not at once
+static void test_paced_chart()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	Display.set_frame_rate(30);
+
+	Mock.clear();
+	draw_chart(Display);
+	CHECK(Mock.m_Data.empty());
+	CHECK(Display.service());
+	CHECK(1 == Display.bus_stats().m_FramesSent);
+	reference(Ref, draw_chart);
+	CHECK(!differ(Emulator, Ref));
+}
+
+#if SSD1306_HEIGHT == 64
+// Paced asynchronous frame with nothing dirty still sends the start line change
+static void test_paced_start_line()
+{
+	SSD1306_emulator Emulator;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	Display.set_frame_rate(30, true);
+
+	Display.set_start_line(12);
+	Display.update_dirty();
+	CHECK(Display.service());
+	CHECK(12 == Emulator.m_StartLine);
+}
+#endif
+
+// Chart columns go in vertical addressing, the controller is back in horizontal addressing after every sample
+static void test_chart_columns()
+{
+	SSD1306_emulator Emulator, Ref;
+	SSD1306_mock Mock(&Emulator);
+	SSD1306_oled Display(Mock);
+	Display.update_screen();
+	draw_chart(Display);
+	CHECK(0 == Emulator.m_AddressMode);
+	reference(Ref, draw_chart);
+	CHECK(!differ(Emulator, Ref));
+
+	SSD1306_oled::StripChart Chart;
+	Display.init_chart(Chart, 0, 0, 10, 8, INT16_MAX, INT16_MAX);  // Empty range at the top of int16_t
+	Display.chart_sample(Chart, INT16_MAX);
+	Display.chart_sample(Chart, 0);
+	CHECK(0 == Emulator.m_AddressMode);
+	CHECK(Emulator.pixel(SSD1306_COLUMN_OFFSET, 0));           // Maximum is the top row
+	CHECK(Emulator.pixel(SSD1306_COLUMN_OFFSET + 1, 7));       // Minimum is the bottom row
+}
+#endif
+
+struct Test
+{
+	void (*m_pRun)();
+	const char *m_pName;
+};
+
+static const Test TESTS[] =
+{
+	{test_point_lines, "point_lines"},
+	{test_zero_circle, "zero_circle"},
+	{test_bus_primask, "bus_primask"},
+#if !SSD1306_TILED
+	{test_bus_busy_commands, "bus_busy_commands"},
+#endif
+	{test_reinit_state, "reinit_state"},
+	{test_hw_scroll, "hw_scroll"},
+#if SSD1306_HEIGHT == 64
+	{test_scroll_rows, "scroll_rows"},
+#endif
+#if SSD1306_CONSOLE
+	{test_console, "console"},
+#endif
+	{test_raster_ops, "raster_ops"},
+	{test_scene, "scene"},
+#if !SSD1306_TILED
+	{test_copy_region, "copy_region"},
+	{test_draw_frame, "draw_frame"},
+	{test_draw_number, "draw_number"},
+	{test_async_completion, "async_completion"},
+	{test_async_front_buffer, "async_front_buffer"},
+	{test_async_wait, "async_wait"},
+	{test_async_error, "async_error"},
+	{test_paced_async_retry, "paced_async_retry"},
+	{test_paced_chart, "paced_chart"},
+#if SSD1306_HEIGHT == 64
+	{test_paced_start_line, "paced_start_line"},
+#endif
+	{test_chart_columns, "chart_columns"},
+#endif
+	{0, 0}
+};
+
+int main()
+{
+	int failed = 0;
+
+	for(const Test *pTest = TESTS; pTest->m_pRun; ++pTest)
+	{
+		bFailed = false;
+		pTest->m_pRun();
+		printf("%s %s\n", bFailed ? "FAIL" : "ok  ", pTest->m_pName);
+		failed += bFailed;
+	}
+
+	return failed;
+}
@@ -0,0 +1,358 @@
+#include "stm32f0xx_hal.h"
+#include "ssd1306_emulator.h"
+
+static const uint8_t MAX_DEVICES = 8;
+static const uint8_t MAX_PINS = 16;
+static const uint8_t MAX_PENDING = 8;
+static const uint16_t DATA_TO_SEND = 0x40;              // I2C control byte bit of the data stream
+
+struct I2cDevice
+{
+	I2C_HandleTypeDef *m_pPort;
+	uint16_t m_Address;                                     // Bit-shifted for 1 pos left like the HAL ones
+	SSD1306_emulator *m_pDevice;                            // 0 for the mux
+	uint8_t m_MuxMask;                                      // Channel of the device, or the selected channels of the mux
+};
+
+struct SpiDevice
+{
+	SPI_HandleTypeDef *m_pPort;
+	GPIO_TypeDef *m_pDC_Port;
+	uint16_t m_DC_Pin;
+	SSD1306_emulator *m_pDevice;
+};
+
+struct PinLevel
+{
+	GPIO_TypeDef *m_pPort;
+	uint16_t m_Pin;
+	GPIO_PinState m_State;
+};
+
+// Asynchronous transfer which is decoded and completed by the interrupt
+struct Transfer
+{
+	I2C_HandleTypeDef *m_pI2C;                              // |
+	SPI_HandleTypeDef *m_pSPI;                              // | One of them is set
+	uint16_t m_Address;
+	bool m_Mem;                                             // HAL_I2C_Mem_Write_xxx(), otherwise the control byte is the first data byte
+	uint16_t m_MemAddress;
+	uint8_t *m_pData;
+	uint16_t m_Size;
+};
+
+static I2cDevice I2cDevices[MAX_DEVICES];
+static uint8_t I2cCount = 0;
+static SpiDevice SpiDevices[MAX_DEVICES];
+static uint8_t SpiCount = 0;
+static PinLevel Pins[MAX_PINS];
+static uint8_t PinsCount = 0;
+static Transfer Pending[MAX_PENDING];
+static uint8_t PendingCount = 0;
+static uint32_t Tick = 0;
+static uint32_t Primask = 0;                            // Interrupts are masked while it is 1, like PRIMASK of Cortex-M
+static bool bInIrq = false;
+static bool bAutoIrq = true;
+
+static I2cDevice *find_mux(I2C_HandleTypeDef *hi2c)
+{
+	for(uint8_t i = 0; i < I2cCount; ++i)
+		if(I2cDevices[i].m_pPort == hi2c && !I2cDevices[i].m_pDevice)
+			return &I2cDevices[i];
+
+	return 0;
+}
+
+// Device which answers at the address now, mux channels are taken into account
+static I2cDevice *find_i2c(I2C_HandleTypeDef *hi2c, uint16_t DevAddress)
+{
+	I2cDevice *pMux = find_mux(hi2c);
+
+	for(uint8_t i = 0; i < I2cCount; ++i)
+	{
+		I2cDevice &Dev = I2cDevices[i];
+		if(Dev.m_pPort != hi2c || Dev.m_Address != DevAddress)
+			continue;
+		if(!Dev.m_pDevice || !Dev.m_MuxMask || (pMux && (pMux->m_MuxMask & Dev.m_MuxMask)))
+			return &Dev;
+	}
+
+	return 0;
+}
+
+static GPIO_PinState pin_state(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	for(uint8_t i = 0; i < PinsCount; ++i)
+		if(Pins[i].m_pPort == GPIOx && Pins[i].m_Pin == GPIO_Pin)
+			return Pins[i].m_State;
+
+	return GPIO_PIN_RESET;
+}
+
+static HAL_StatusTypeDef i2c_transfer(const Transfer &T)
+{
+	I2cDevice *pDev = find_i2c(T.m_pI2C, T.m_Address);
+	if(!pDev)
+		return HAL_ERROR;                                    // NACK
+	if(!pDev->m_pDevice)
+	{
+		if(T.m_Size)
+			pDev->m_MuxMask = T.m_pData[T.m_Size - 1];
+		return HAL_OK;
+	}
+
+	if(T.m_Mem)
+		pDev->m_pDevice->write(T.m_MemAddress & DATA_TO_SEND, T.m_pData, T.m_Size);
+	else if(T.m_Size)
+		pDev->m_pDevice->write(T.m_pData[0] & DATA_TO_SEND, T.m_pData + 1, T.m_Size - 1);
+
+	return HAL_OK;
+}
+
+// D/C is sampled when the bytes are on the wire, so a pin changed before the completion spoils the transfer like on the panel
+static HAL_StatusTypeDef spi_transfer(const Transfer &T)
+{
+	for(uint8_t i = 0; i < SpiCount; ++i)
+	{
+		SpiDevice &Dev = SpiDevices[i];
+		if(Dev.m_pPort != T.m_pSPI)
+			continue;
+		Dev.m_pDevice->write(GPIO_PIN_SET == pin_state(Dev.m_pDC_Port, Dev.m_DC_Pin), T.m_pData, T.m_Size);
+		return HAL_OK;
+	}
+
+	return HAL_OK;                                         // SPI has no acknowledge
+}
+
+static bool port_busy(const void *pPort)
+{
+	for(uint8_t i = 0; i < PendingCount; ++i)
+		if(Pending[i].m_pI2C == pPort || Pending[i].m_pSPI == pPort)
+			return true;
+
+	return false;
+}
+
+static HAL_StatusTypeDef start(const Transfer &T)
+{
+	if(PendingCount == MAX_PENDING || port_busy(T.m_pI2C ? (const void *)T.m_pI2C : (const void *)T.m_pSPI))
+		return HAL_BUSY;
+
+	Pending[PendingCount++] = T;
+	return HAL_OK;
+}
+
+static HAL_StatusTypeDef run(const Transfer &T)
+{
+	if(port_busy(T.m_pI2C ? (const void *)T.m_pI2C : (const void *)T.m_pSPI))
+		return HAL_BUSY;
+
+	return T.m_pI2C ? i2c_transfer(T) : spi_transfer(T);
+}
+
+static Transfer make(I2C_HandleTypeDef *hi2c, SPI_HandleTypeDef *hspi, uint16_t DevAddress, bool bMem, uint16_t MemAddress,
+                     uint8_t *pData, uint16_t Size)
+{
+	Transfer T = {hi2c, hspi, DevAddress, bMem, MemAddress, pData, Size};
+	return T;
+}
+
+// Completes the oldest asynchronous transfer: decodes it and calls the HAL callback
+static bool interrupt()
+{
+	if(!PendingCount || bInIrq)
+		return false;
+
+	Transfer T = Pending[0];
+	for(uint8_t i = 1; i < PendingCount; ++i)
+		Pending[i - 1] = Pending[i];
+	--PendingCount;
+
+	bInIrq = true;
+	if(T.m_pI2C)
+	{
+		if(HAL_OK != i2c_transfer(T))
+			HAL_I2C_ErrorCallback(T.m_pI2C);
+		else if(T.m_Mem)
+			HAL_I2C_MemTxCpltCallback(T.m_pI2C);
+		else
+			HAL_I2C_MasterTxCpltCallback(T.m_pI2C);
+	}
+	else
+	{
+		spi_transfer(T);
+		HAL_SPI_TxCpltCallback(T.m_pSPI);
+	}
+	bInIrq = false;
+
+	return true;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	if(bAutoIrq && !Primask)
+		interrupt();
+
+	return Tick++;
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+	Tick += Delay;
+}
+
+void __disable_irq(void)
+{
+	Primask = 1;
+}
+
+void __enable_irq(void)
+{
+	Primask = 0;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return Primask;
+}
+
+void __set_PRIMASK(uint32_t priMask)
+{
+	Primask = priMask & 1;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	for(uint8_t i = 0; i < PinsCount; ++i)
+	{
+		if(Pins[i].m_pPort == GPIOx && Pins[i].m_Pin == GPIO_Pin)
+		{
+			Pins[i].m_State = PinState;
+			return;
+		}
+	}
+	if(PinsCount < MAX_PINS)
+	{
+		PinLevel Pin = {GPIOx, GPIO_Pin, PinState};
+		Pins[PinsCount++] = Pin;
+	}
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint32_t, uint32_t)
+{
+	if(port_busy(hi2c))
+		return HAL_BUSY;
+
+	return find_i2c(hi2c, DevAddress) ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t,
+                                    uint8_t *pData, uint16_t Size, uint32_t)
+{
+	return run(make(hi2c, 0, DevAddress, true, MemAddress, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t,
+                                        uint8_t *pData, uint16_t Size)
+{
+	return start(make(hi2c, 0, DevAddress, true, MemAddress, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t,
+                                       uint8_t *pData, uint16_t Size)
+{
+	return start(make(hi2c, 0, DevAddress, true, MemAddress, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t)
+{
+	return run(make(hi2c, 0, DevAddress, false, 0, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+	return start(make(hi2c, 0, DevAddress, false, 0, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+	return start(make(hi2c, 0, DevAddress, false, 0, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t)
+{
+	return run(make(0, hspi, 0, false, 0, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+	return start(make(0, hspi, 0, false, 0, pData, Size));
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+	return start(make(0, hspi, 0, false, 0, pData, Size));
+}
+
+__attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *) {}
+__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *) {}
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *) {}
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *) {}
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *) {}
+
+void HAL_Host_AttachI2C(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, SSD1306_emulator *pDevice, int8_t mux_channel)
+{
+	if(I2cCount == MAX_DEVICES || !pDevice)
+		return;
+
+	I2cDevice Dev = {hi2c, (uint16_t)(i2c_addr << 1), pDevice, (uint8_t)(mux_channel < 0 ? 0 : 1 << mux_channel)};
+	I2cDevices[I2cCount++] = Dev;
+}
+
+void HAL_Host_AttachMux(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr)
+{
+	if(I2cCount == MAX_DEVICES || find_mux(hi2c))
+		return;
+
+	I2cDevice Dev = {hi2c, (uint16_t)(i2c_addr << 1), 0, 0};
+	I2cDevices[I2cCount++] = Dev;
+}
+
+void HAL_Host_AttachSPI(SPI_HandleTypeDef *hspi, GPIO_TypeDef *DC_GPIOx, uint16_t DC_GPIO_PIN, SSD1306_emulator *pDevice)
+{
+	if(SpiCount == MAX_DEVICES || !pDevice)
+		return;
+
+	SpiDevice Dev = {hspi, DC_GPIOx, DC_GPIO_PIN, pDevice};
+	SpiDevices[SpiCount++] = Dev;
+}
+
+// Removes all devices and drops the transfers in progress, the tick goes on
+void HAL_Host_Detach()
+{
+	I2cCount = SpiCount = PinsCount = PendingCount = 0;
+	Primask = 0;
+	bAutoIrq = true;
+}
+
+// Off: asynchronous transfers stay in progress until HAL_Host_RunInterrupts(), e.g. for checking the busy states
+void HAL_Host_AutoInterrupts(bool bOn)
+{
+	bAutoIrq = bOn;
+}
+
+// Completes the asynchronous transfers, including the ones started from the callbacks. Returns their count
+uint32_t HAL_Host_RunInterrupts()
+{
+	uint32_t count = 0;
+
+	while(interrupt())
+		++count;
+
+	return count;
+}
+
+uint32_t HAL_Host_Pending()
+{
+	return PendingCount;
+}
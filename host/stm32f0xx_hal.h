@@ -0,0 +1,65 @@
+/*
+ * stm32f0xx_hal.h
+ *
+ * Stand-in for the STM32 HAL, so the driver builds and runs on a Linux host. Put this directory in front of the include path:
+ *   g++ -Ihost -I. -I<fonts and buffer dir> test.cpp ssd_1306.cpp ssd_1306_transport.cpp host/stm32f0xx_hal.cpp
+ *       host/ssd1306_emulator.cpp <fonts dir>/fonts.c
+ * Bus calls go to the SSD1306_emulator (ssd1306_emulator.h) attached to the I2C address or to the SPI port,
+ * a transaction to an address without a device fails like a NACK. HAL_GetTick() counts its calls, so delays
+ * and timeouts pass at once. Asynchronous transfers are decoded and completed by the next HAL_GetTick() call
+ * outside of the callbacks and of __disable_irq(), the way the interrupt comes while the main loop polls;
+ * HAL_Host_RunInterrupts() completes them explicitly
+ */
+
+#ifndef STM32F0XX_HAL_H_
+#define STM32F0XX_HAL_H_
+
+#include <stdint.h>
+
+typedef enum {HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT} HAL_StatusTypeDef;
+typedef enum {GPIO_PIN_RESET = 0, GPIO_PIN_SET} GPIO_PinState;
+typedef struct {int m_Id;} I2C_HandleTypeDef;
+typedef struct {int m_Id;} SPI_HandleTypeDef;
+typedef struct {int m_Id;} GPIO_TypeDef;
+
+class SSD1306_emulator;
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                    uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                        uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+                                       uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+
+// Weak callbacks like the ones of the HAL, the application overrides them
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+
+// Host side of the bus. I2C addresses are 7-bit. Mux channel is the channel of a TCA9548A-like mux attached
+// by HAL_Host_AttachMux(), the device answers only while the channel is selected. D/C pin of SPI tells data from commands
+void HAL_Host_AttachI2C(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, SSD1306_emulator *pDevice, int8_t mux_channel = -1);
+void HAL_Host_AttachMux(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr);
+void HAL_Host_AttachSPI(SPI_HandleTypeDef *hspi, GPIO_TypeDef *DC_GPIOx, uint16_t DC_GPIO_PIN, SSD1306_emulator *pDevice);
+void HAL_Host_Detach();
+void HAL_Host_AutoInterrupts(bool bOn);
+uint32_t HAL_Host_RunInterrupts();
+uint32_t HAL_Host_Pending();
+
+#endif /* STM32F0XX_HAL_H_ */
@@ -11,24 +11,89 @@
 #include <string.h>
 
 #include "stm32f0xx_hal.h"
+#include "ssd1306_transport.h"
 #include "fonts.h"
 #include "buffer.h"
 
 #define SWAP_UINT16_T(a, b) { uint16_t t = a; a = b; b = t; }
+#define SWAP_INT16_T(a, b) { int16_t t = a; a = b; b = t; }
+
+// Display geometry is set at compile time, e.g. -DSSD1306_WIDTH=128 -DSSD1306_HEIGHT=32 for 128x32 modules
+// or -DSSD1306_WIDTH=72 -DSSD1306_HEIGHT=40 for 72x40 ones. Panels narrower than 128 columns are usually
+// wired to the middle of the controller segments, SSD1306_COLUMN_OFFSET is the first visible column
+#ifndef SSD1306_WIDTH
+#define SSD1306_WIDTH 128
+#endif
+#ifndef SSD1306_HEIGHT
+#define SSD1306_HEIGHT 64
+#endif
+#ifndef SSD1306_COLUMN_OFFSET
+#define SSD1306_COLUMN_OFFSET ((128 - SSD1306_WIDTH) / 2)
+#endif
+// Front buffer for asynchronous transfers. Without it (0) the asynchronous transfer goes straight
+// from the drawing buffer and drawing must wait until is_busy() returns false, but 1 KB of RAM is saved
+#ifndef SSD1306_DOUBLE_BUFFER
+#define SSD1306_DOUBLE_BUFFER 1
+#endif
+// Page-tiled rendering for MCUs with a few KB of RAM. Drawing calls are recorded into a display list of
+// SSD1306_DISPLAY_LIST_SIZE bytes, and update_screen() rasterizes it one page at a time into a single page buffer,
+// sending every page before the next one is rendered. Asynchronous updates are not available in this mode
+#ifndef SSD1306_TILED
+#define SSD1306_TILED 0
+#endif
+#ifndef SSD1306_DISPLAY_LIST_SIZE
+#define SSD1306_DISPLAY_LIST_SIZE 256
+#endif
+#if SSD1306_TILED
+#undef SSD1306_DOUBLE_BUFFER
+#define SSD1306_DOUBLE_BUFFER 0
+#endif
+// Text console scrolls by the display start line, which goes round 64 GDDRAM rows, so it needs a 64 rows
+// screen and the whole frame in the buffer
+#define SSD1306_CONSOLE (SSD1306_HEIGHT == 64 && !SSD1306_TILED)
+
+#if SSD1306_WIDTH > 128 || SSD1306_HEIGHT > 64 || SSD1306_HEIGHT % 8 || SSD1306_HEIGHT < 16
+#error "SSD1306: unsupported display geometry"
+#endif
+#if SSD1306_COLUMN_OFFSET + SSD1306_WIDTH > 128
+#error "SSD1306: column offset is out of the controller columns"
+#endif
 
 class SSD1306_oled;
 
 void over(SSD1306_oled &Obj);
 
 enum FONT {_7x10, _11x18, _16x26};
+enum DRAW_MODE {_DRAW_OR, _DRAW_CLEAR, _DRAW_XOR};
+// How image pixels are combined with the buffer ones: copy, OR, AND, XOR or copy of the inverted image
+enum RASTER_OP {_ROP_COPY, _ROP_OR, _ROP_AND, _ROP_XOR, _ROP_INVERT};
+enum SCROLL_DIRECTION {_SCROLL_RIGHT, _SCROLL_LEFT, _SCROLL_UP_RIGHT, _SCROLL_UP_LEFT};
+// Time between continuous scroll steps in frames, values are the controller codes
+enum SCROLL_INTERVAL {_SCROLL_5_FRAMES, _SCROLL_64_FRAMES, _SCROLL_128_FRAMES, _SCROLL_256_FRAMES, _SCROLL_3_FRAMES,
+                      _SCROLL_4_FRAMES, _SCROLL_25_FRAMES, _SCROLL_2_FRAMES};
+// Blink effects: whole screen inverted, all pixels lit, display off
+enum SCREEN_EFFECT {_EFFECT_INVERT, _EFFECT_FLASH, _EFFECT_PULSE};
+// Contrast change over the fade: even or slow at first and fast at the end, which looks more even to the eye
+enum FADE_CURVE {_FADE_LINEAR, _FADE_SQUARE};
+
+// Font pre-transposed to the GDDRAM layout, made from FontDef tables by tools/ssd1306_fontconv.cpp. Glyph of every
+// char 32...126 is (m_Height + 7) / 8 pages of m_Width column bytes, bit 0 of a byte is the top row of the page
+typedef struct
+{
+	uint8_t m_Width;
+	uint8_t m_Height;
+	const uint8_t *m_pData;
+} PageFontDef;
 
 class SSD1306_oled
 {
 	// ==================================  Static constant private variables ========================================== //
-	static const uint8_t DISPLAY_WIDTH = 128;
-	static const uint8_t DISPLAY_HEIGHT = 64;
-	static const uint16_t BUFFER_SIZE = (DISPLAY_WIDTH * DISPLAY_HEIGHT) >> 3;
-	static const uint8_t PAGES_COUNT = 8;
+	static const uint8_t DISPLAY_WIDTH = SSD1306_WIDTH;
+	static const uint8_t DISPLAY_HEIGHT = SSD1306_HEIGHT;
+	static const uint8_t PAGES_COUNT = DISPLAY_HEIGHT >> 3;
+	static const uint8_t BUFFER_PAGES = SSD1306_TILED ? 1 : PAGES_COUNT;
+	static const uint16_t BUFFER_SIZE = DISPLAY_WIDTH * BUFFER_PAGES;
+	static const uint8_t COLUMN_OFFSET = SSD1306_COLUMN_OFFSET;
 	
 	static const uint8_t SET_CONTRAST_CONTROL = 0x81;      // Address of setting of a contrast range. Demands additional data with value 1...256
 	static const uint8_t RESUME_DISPLAY_RAM = 0xA4;        // Resume to RAM content display (reset state). Output follows RAM content
@@ -57,6 +122,20 @@ class SSD1306_oled
 	static const uint8_t SET_COM_NORMAL_MAPPING = 0xC0;    // Set COM output scan direction. Nolmal displaying (reset state)
 	static const uint8_t SET_COM_REFL_MAPPING = 0xC8;      // Set COM output scan direction. Vertical reflected displaying (reset state)
 	static const uint8_t SET_DISPLAY_OFFSET = 0xD3;        // Set vertical shift by COM. Demands additional data with value 0...63. Reset value is 0
+	static const uint8_t SET_START_LINE = 0x40;            // Set display start line, GDDRAM row shown at the top. Row 0...63 is added to the command
+	static const uint8_t RAM_ROWS = 64;                    // GDDRAM rows, display start line goes round them
+	
+	// Continuous scroll setup. Horizontal scroll demands 6 additional data values:
+	//  - dummy 0x00, start page 0...7, interval (SCROLL_INTERVAL), end page 0...7, dummy 0x00 and dummy 0xFF
+	// Vertical and horizontal scroll demands 5 additional data values:
+	//  - dummy 0x00, start page 0...7, interval (SCROLL_INTERVAL), end page 0...7, vertical offset 1...63 rows per step
+	static const uint8_t RIGHT_HORIS_SCROLL = 0x26;
+	static const uint8_t LEFT_HORIS_SCROLL = 0x27;
+	static const uint8_t VERT_RIGHT_HORIS_SCROLL = 0x29;
+	static const uint8_t VERT_LEFT_HORIS_SCROLL = 0x2A;
+	static const uint8_t SET_VERT_SCROLL_AREA = 0xA3;      // Demands count of fixed top rows and count of rows in the vertical scroll area
+	static const uint8_t DEACTIVATE_SCROLL = 0x2E;         // GDDRAM must be rewritten after this command
+	static const uint8_t ACTIVATE_SCROLL = 0x2F;           // GDDRAM must not be changed until DEACTIVATE_SCROLL
 	
 	// Address of setting of the divide ratio and the oscillator frequency of the display clock.
 	// Demands one 8-bit additional data value, consists of two parts:
@@ -71,57 +150,309 @@ class SSD1306_oled
 	static const uint8_t _ALTERNATIVE_HW_PIN_CONF = 0x10;   // Alternative COM pin configuration without right/left remapping (reset state). Use after SET_COM_PIN_HW_CONF command
 	static const uint8_t _SEQUENTIAL_HW_PIN_CONF_R = 0x20;  // Sequential COM pin configuration with right/left remapping. Use after SET_COM_PIN_HW_CONF command
 	static const uint8_t _ALTERNATIVE_HW_PIN_CONF_R = 0x30; // Alternative COM pin configuration with right/left remapping. Use after SET_COM_PIN_HW_CONF command
-	static const uint8_t COMMAND_TO_SEND = 0x00;            // I2C mark for device if it is command to send
-	static const uint8_t COMMAND_SEND_TIMEOUT = 10;         // I2C timeout for sending
-	static const uint8_t DATA_TO_SEND = 0x40;               // I2C mark for device if it is data to send
+	static const uint8_t COMMAND_SEND_TIMEOUT = 10;         // Bus timeout for sending
+	static const uint8_t COMMAND_BATCH_SIZE = 32;           // Maximum count of command bytes which are sent in one I2C transaction
+	static const uint8_t FRAME_DELTA = 0x01;                // Animation frame flags: frame is XORed with the buffer instead of replacing it
+	static const uint8_t FRAME_END = 0xFF;                  // Animation frame flags: end of the stream
+	static const uint8_t FRAME_RUN_REPEAT = 0x80;           // Animation run control byte: one byte repeated instead of literal bytes
+	static const uint8_t NUMBER_FIELD_SIZE = 12;            // Maximum width of a numeric field in chars, enough for any int32_t
+	
+	// Geometry dependent initialization values
+	static const uint8_t MULTIPLEX_RATIO = DISPLAY_HEIGHT - 1;
+	static const uint8_t COM_PIN_HW_CONF = 32 == DISPLAY_HEIGHT ? _SEQUENTIAL_HW_PIN_CONF : _ALTERNATIVE_HW_PIN_CONF;
 	// ------------------------------------------------------------------------------------------------------------- //
 	
+	public:
+	// Bus traffic and frame pacing counters since the construction or reset_bus_stats(), see bus_stats()
+	struct BusStats
+	{
+		uint32_t m_Transactions;                              // Transport writes which were accepted, synchronous and asynchronous
+		uint32_t m_CommandBytes;
+		uint32_t m_DataBytes;
+		uint32_t m_BlockedTicks;                              // Time in ms spent in synchronous writes and in waiting for asynchronous transfers
+		uint32_t m_Updates;                                   // Calls of update_xxx() which sent the frame, started asynchronous updates and chart samples
+		uint32_t m_FramesSent;                                // Frames sent by service() in the paced mode
+		uint32_t m_FramesCoalesced;                           // Update requests of the paced mode joined to the frame which was pending already
+	};
+	
+	private:
 	// ==================================== Others private class members =========================================== //
-	I2C_HandleTypeDef *m_I2C_Port;                          // STM32 I2C port
-	uint16_t m_SSD1306_I2C_Address;                         // SSD1306 I2C address, bit-shifted for 1 pos left
-	GPIO_TypeDef* m_GPIO_Port;                              // STM32 GPIO port for reseting OLED
-	uint16_t m_GPIO_Pin;                                    // STM32 GPIO pin for reseting OLED
-	uint8_t *m_pBuffer;                                     // Buffer pointer to collect information to display
+	SSD1306_i2c m_I2C;                                      // Transport of the I2C constructor
+	SSD1306_transport *m_pTransport;                        // Bus to the controller
+	uint8_t m_Buffer[BUFFER_SIZE];                          // Buffer to collect information to display
 	uint8_t *m_pBuffer_beg;                                 // First value of buffer pointer to transmit data
 	bool m_InitState;                                       // Initialization flag
-	uint8_t m_CurX;                                         // |
-	uint8_t m_CurY;                                         // | Conditional position of cursor in m_pBuffer for text printing
+	
+	// Steps of the non-blocking initialization, see init_step()
+	enum INIT_STEP {_INIT_IDLE, _INIT_POWER_UP, _INIT_PROBE, _INIT_RESET_LOW, _INIT_RESET_HIGH, _INIT_CONFIGURE, _INIT_CLEAR, _INIT_DONE, _INIT_FAILED};
+	INIT_STEP m_InitStep;                                   // Current step of initialization
+	uint32_t m_InitWake;                                    // Tick when the current step may be done
+	uint32_t m_InitBeg;                                     // Tick when initialization began
+	uint32_t m_InitLatency;                                 // Duration of the last initialization in ms
+	bool m_WarmRestart;                                     // Controller is already configured, skip the reset and the clearing
+	int16_t m_CurX;                                         // |
+	int16_t m_CurY;                                         // | Conditional position of cursor in m_Buffer for text printing
+	int16_t m_ClipX0;                                       // |
+	int16_t m_ClipY0;                                       // |
+	int16_t m_ClipX1;                                       // |
+	int16_t m_ClipY1;                                       // | Clip rectangle, inclusive. Nothing is drawn outside of it
+	uint8_t m_StartLine;                                    // Display start line, buffer row shown at the top of the screen
+	bool m_HwScroll;                                        // Continuous scroll is running, GDDRAM can't be written
+#if SSD1306_CONSOLE
+	bool m_Console;                                         // Streamed text goes to the console, see set_console()
+	int16_t m_ConsoleY;                                     // Screen row of the current console line
+#endif
+	uint8_t m_DirtyBeg[PAGES_COUNT];                        // | First and last changed column of every page since the last transmission.
+	uint8_t m_DirtyEnd[PAGES_COUNT];                        // | Page is clean if m_DirtyBeg > m_DirtyEnd
+	
+#if SSD1306_DOUBLE_BUFFER
+	uint8_t m_FrontBuffer[BUFFER_SIZE];                     // Frame copy which is transmitted asynchronously while drawing goes on in m_Buffer
+#endif
+	volatile bool m_TxBusy;                                 // Asynchronous transfer is in progress
+	ASYNC_TRANSFER m_TxMode;                                // HAL transfer type for asynchronous updates
+	uint8_t m_TxBeg[PAGES_COUNT];                           // |
+	uint8_t m_TxEnd[PAGES_COUNT];                           // | Dirty spans snapshot of the asynchronous transfer
+	uint8_t m_TxPage;                                       // |
+	uint8_t m_TxLastPage;                                   // | Window of the asynchronous transfer which is currently on the wire
+	bool m_TxDataPhase;                                     // Window address is sent, window data goes next
+	uint8_t m_TxCmd[6];                                     // Addressing command stream of the current window
+	void (*m_pTxCallback)(SSD1306_oled &Obj);               // User callback for the asynchronous transfer completion
 	FONT m_DefFont;                                         // Default font for printing
 	
 	char_buffer cBuf;                                       // Buffer for transformation data to string-type
+	
+	uint8_t m_CmdBatch[COMMAND_BATCH_SIZE];                 // Command bytes collected for sending as one command stream
+	uint8_t m_CmdCount;                                     // Count of command bytes in m_CmdBatch
+	BusStats m_Stats;                                       // Traffic counters, see bus_stats()
+	uint16_t m_FrameInterval;                               // Minimum ms between frames of the paced mode, 0 if updates are sent at once
+	uint32_t m_LastFrame;                                   // Tick of the last paced frame
+	bool m_FramePending;                                    // Update was requested in the paced mode, service() sends it
+	bool m_PacedAsync;                                      // Paced frames go by asynchronous transfer
+	uint8_t m_Contrast;                                     // |
+	bool m_Inverse;                                         // |
+	bool m_DisplayOn;                                       // | Display state set by the user, effects return to it
+	bool m_Fading;                                          // Contrast fade is running, see fade()
+	uint8_t m_FadeFrom;                                     // |
+	uint8_t m_FadeTo;                                       // |
+	FADE_CURVE m_FadeCurve;                                 // |
+	uint32_t m_FadeBeg;                                     // |
+	uint16_t m_FadeDuration;                                // | Contrast fade
+	bool m_Blinking;                                        // Blink effect is running, see blink()
+	SCREEN_EFFECT m_BlinkEffect;                            // |
+	uint32_t m_BlinkBeg;                                    // |
+	uint16_t m_BlinkHalf;                                   // | Half of the blink period in ms, the effect is on in the even halves
+	uint16_t m_BlinkHalves;                                 // | Halves to run, 0 until stop_effect()
+	bool m_BlinkOn;                                         // | Effect is on the screen now
+	
+	// Display list record types. Every record is the type byte followed by 16-bit arguments,
+	// text record is {_CMD_TEXT or _CMD_PAGE_TEXT, font index, x, y, chars count, chars...},
+	// polygon record is {_CMD_POLYGON, fill mode or 0xFF for outline, points count, x0, y0, x1, y1...},
+	// bitmap record is {_CMD_BITMAP, raster op, x, y, width, height, image pointer, mask pointer}
+	enum DRAW_COMMAND {_CMD_PIXEL, _CMD_PIXEL_INVERTED, _CMD_HORISONTAL_LINE, _CMD_VERTICAL_LINE, _CMD_LINE, _CMD_RECTANGLE,
+	                   _CMD_FILL_RECTANGLE, _CMD_TRIANGLE, _CMD_FILL_TRIANGLE, _CMD_CIRCLE, _CMD_FILL_CIRCLE, _CMD_CLIP,
+	                   _CMD_TEXT, _CMD_POLYGON, _CMD_PAGE_TEXT, _CMD_BITMAP};
+#if SSD1306_TILED
+	static const uint8_t LIST_FONTS_COUNT = 4;              // Maximum count of different fonts in display list
+	static const uint16_t NO_TEXT_RECORD = 0xFFFF;
+	static const uint8_t LIST_POLYGON_POINTS = 16;          // Maximum count of polygon points in display list
+	uint8_t m_List[SSD1306_DISPLAY_LIST_SIZE];              // Display list of the current frame
+	uint16_t m_ListSize;                                    // Used bytes of m_List
+	uint16_t m_LastText;                                    // Offset of the last record if it is text, which the next char may be appended to
+	FontDef m_ListFonts[LIST_FONTS_COUNT];                  // Fonts used in display list
+	uint8_t m_ListFontsCount;
+	PageFontDef m_ListPageFonts[LIST_FONTS_COUNT];          // Page-oriented fonts used in display list
+	uint8_t m_ListPageFontsCount;
+	bool m_ListOverflow;                                    // Some drawing was lost because display list is full
+	bool m_Replaying;                                       // Drawing calls rasterize display list records instead of recording
+	uint8_t m_BufPage;                                      // Page which is rendered in m_Buffer now
+#endif
 	// ------------------------------------------------------------------------------------------------------------- //
 	
 	// =================================== Private class member functions ========================================== //
 	void i2c_WriteCommand(uint8_t nCommand);
+	HAL_StatusTypeDef i2c_FlushCommands();
 	void i2c_WriteData(uint8_t *pData, uint16_t nSize);
-	void reset_oled();
-	void inline check_limits(uint16_t &x, uint16_t &y);
+	void init_wait(INIT_STEP nextStep, uint32_t ms);
+	// Bresenham stepping state of the visible part of a line, see clip_line()
+	struct LineStepper
+	{
+		int16_t m_Major;                                      // Current and last coordinates along the major axis
+		int16_t m_MajorEnd;
+		int16_t m_Minor;                                      // Current coordinate along the minor axis
+		int8_t m_MinorStep;
+		bool m_Steep;                                         // Major axis is y
+		int32_t m_Err;
+		int32_t m_Dx;
+		int32_t m_Dy;
+	};
+	
+	bool clip_box(int32_t &x_beg, int32_t &y_beg, int32_t &x_end, int32_t &y_end);
+	bool clip_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t xMin, int16_t yMin, int16_t xMax, int16_t yMax, LineStepper &line);
+	void inline put_pixel(int16_t x, int16_t y, bool bSet);
+	void inline plot(int16_t x, int16_t y);
+	uint8_t inline *page_ptr(uint8_t page);
+	void fill_span(int32_t x, int32_t y, int32_t width, int32_t height, DRAW_MODE mode);
+	void line_spans(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t *pMin, int16_t *pMax);
+	void fill_rows(const int16_t *pMin, const int16_t *pMax, DRAW_MODE mode);
+	void blit(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pData, uint16_t stride, uint8_t row_offset,
+	          const uint8_t *pMask, RASTER_OP op);
+#if SSD1306_TILED
+	bool record(DRAW_COMMAND cmd, uint16_t a0 = 0, uint16_t a1 = 0, uint16_t a2 = 0, uint16_t a3 = 0, uint16_t a4 = 0, uint16_t a5 = 0, uint16_t a6 = 0);
+	bool record_char(char ch, const FontDef &Font);
+	bool record_char(char ch, const PageFontDef &Font);
+	bool record_text(DRAW_COMMAND cmd, uint8_t font, uint8_t width, char ch);
+	bool record_polygon(const int16_t *pPoints, uint8_t count, uint8_t mode);
+	bool record_bitmap(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, RASTER_OP op, const uint8_t *pMask);
+	void replay(uint8_t page);
+#else
+	bool record(DRAW_COMMAND, uint16_t = 0, uint16_t = 0, uint16_t = 0, uint16_t = 0, uint16_t = 0, uint16_t = 0, uint16_t = 0) { return false; }
+	bool record_char(char, const FontDef &) { return false; }
+	bool record_char(char, const PageFontDef &) { return false; }
+	bool record_polygon(const int16_t *, uint8_t, uint8_t) { return false; }
+	bool record_bitmap(int16_t, int16_t, uint16_t, uint16_t, const uint8_t *, RASTER_OP, const uint8_t *) { return false; }
+#endif
+	void clear_rows(uint8_t row, uint8_t count);
+#if SSD1306_CONSOLE
+	void console_char(char ch, const FontDef &Font);
+	void console_new_line(uint8_t height);
+#endif
+#if !SSD1306_TILED
+	void send_columns(uint8_t x_beg, uint8_t x_end, uint8_t page_beg, uint8_t page_end);
+#endif
+	void mark_dirty(int16_t x_beg, int16_t y_beg, int16_t x_end, int16_t y_end);
+	void mark_clean();
+	void inline mark_dirty_byte(uint16_t offset);
+	bool next_window(const uint8_t *pBeg, const uint8_t *pEnd, uint8_t &page, uint8_t &lastPage);
+	bool start_async(bool bFullFrame, void (*pCallback)(SSD1306_oled &Obj));
+	bool tx_next();
+	HAL_StatusTypeDef bus_write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout);
+	void count_write(bool bData, uint16_t nSize, HAL_StatusTypeDef status);
+	bool defer_update(bool bFullFrame);
+	void send_screen();
+	void send_dirty();
+	void show_blink(bool bOn);
+	HAL_StatusTypeDef tx_write(bool bData, uint8_t *pData, uint16_t nSize);
+	void setup(bool bDeferInit);
 	// ------------------------------------------------------------------------------------------------------------- //
 	
 	public:		
+	// Live numeric readout, see init_number() and draw_number(). Remembers the chars which are on the screen,
+	// so a new value redraws and transmits only the changed ones
+	struct NumberField
+	{
+		int16_t m_X;
+		int16_t m_Y;
+		const FontDef *m_pFont;                               // | Font of the field, one of them is set
+		const PageFontDef *m_pPageFont;                       // |
+		uint8_t m_CharWidth;                                  // Glyph width of the font, the step of the chars
+		uint8_t m_Width;                                      // Field width in chars
+		uint8_t m_Decimals;                                   // Digits after the decimal point of fixed-point values
+		bool m_RightAlign;
+		char m_Drawn[NUMBER_FIELD_SIZE];                      // Chars drawn last time, 0 for a char which isn't drawn yet
+	};
+	
+	// Sweeping strip chart, see init_chart() and chart_sample(). Samples go to the ring column one by one
+	// and the column ahead of it is erased, so the trace is redrawn over itself like on a patient monitor
+	struct StripChart
+	{
+		uint8_t m_X;
+		uint8_t m_Width;
+		uint8_t m_PageBeg;                                    // |
+		uint8_t m_PageEnd;                                    // | Pages of the chart
+		int16_t m_Min;                                        // |
+		int16_t m_Max;                                        // | Values at the bottom and at the top of the chart
+		uint8_t m_Column;                                     // Ring column for the next sample, 0...m_Width - 1
+		int16_t m_Row;                                        // Row of the previous sample or -1
+	};
+	
+	private:
+	void init_field(NumberField &Field, int16_t x, int16_t y, uint8_t char_width, uint8_t width, uint8_t decimals, bool bRightAlign);
+	
+	public:
 	// =================================== Public class member functions ========================================== //	
-	SSD1306_oled(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN);
+	SSD1306_oled(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN, bool bDeferInit = false);
+	SSD1306_oled(SSD1306_transport &Transport, bool bDeferInit = false);
 	~SSD1306_oled();
-	uint8_t ssd1306_Init();		
+	uint8_t ssd1306_Init(bool bWarmRestart = false);
+	void begin_init(bool bWarmRestart = false);
+	bool init_step();
+	bool is_initialized() const;
+	uint32_t init_latency() const;
 	void update_screen();
+	void update_dirty();
+	void update_region(int16_t x, int16_t y, uint16_t width, uint16_t height);
+	void invalidate();
+	void set_frame_rate(uint8_t max_fps, bool bAsync = false);
+	bool service();
+	bool update_screen_async(void (*pCallback)(SSD1306_oled &Obj) = 0);
+	bool update_dirty_async(void (*pCallback)(SSD1306_oled &Obj) = 0);
+	void set_async_transfer(ASYNC_TRANSFER mode);
+	bool is_busy() const;
+	bool wait(uint32_t timeout = 100);
+	void transfer_complete(const void *pHandle);
+	void transfer_error(const void *pHandle);
+	const BusStats &bus_stats() const;
+	void reset_bus_stats();
+	uint16_t frames_per_update() const;
 	void clear_screen();
 	void clear_buffer();
 	void set_pos(uint8_t pos_x_beg, uint8_t pos_y_beg, uint8_t pos_x_end = DISPLAY_WIDTH - 1, uint8_t pos_y_end = DISPLAY_HEIGHT - 1);
-	void set_cursor(uint16_t x, uint16_t y);
-	void draw_pixel(uint16_t x, uint16_t y);
-	void draw_pixel_inverted(uint16_t x, uint16_t y);
-	void draw_horisontal_line(uint16_t x, uint16_t y, uint16_t length, uint16_t thickness = 1);
-	void draw_vertical_line(uint16_t x, uint16_t y, uint16_t length, uint16_t thickness = 1);
-	void draw_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
-	void draw_rectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t thickness = 1);
-	void draw_fill_rectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
-	void draw_triangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3);
-	void draw_fill_triangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3);
-	void draw_circle(uint16_t x0, uint16_t y0, uint16_t radius);
-	void draw_fill_circle(uint16_t x0, uint16_t y0, uint16_t radius);
+	void set_cursor(int16_t x, int16_t y);
+	void set_clip(int16_t x, int16_t y, uint16_t width, uint16_t height);
+	void reset_clip();
+	void start_scroll(SCROLL_DIRECTION direction, uint8_t page_beg, uint8_t page_end, SCROLL_INTERVAL interval,
+	                  uint8_t vert_offset = 1, uint8_t fixed_rows = 0, uint8_t area_rows = DISPLAY_HEIGHT);
+	void stop_scroll();
+	bool is_scrolling() const;
+#if SSD1306_HEIGHT == 64
+	void set_start_line(uint8_t line);
+	uint8_t get_start_line() const;
+	void scroll_rows(int8_t rows);
+	int16_t view_row(int16_t y) const;
+#endif
+	void draw_pixel(int16_t x, int16_t y);
+	void draw_pixel_inverted(int16_t x, int16_t y);
+	void draw_horisontal_line(int16_t x, int16_t y, uint16_t length, uint16_t thickness = 1);
+	void draw_vertical_line(int16_t x, int16_t y, uint16_t length, uint16_t thickness = 1);
+	void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+	void draw_rectangle(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t thickness = 1);
+	void draw_fill_rectangle(int16_t x, int16_t y, uint16_t width, uint16_t height, DRAW_MODE mode = _DRAW_OR);
+	void draw_triangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3);
+	void draw_fill_triangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, DRAW_MODE mode = _DRAW_OR);
+	void draw_polygon(const int16_t *pPoints, uint8_t count);
+	void draw_fill_polygon(const int16_t *pPoints, uint8_t count, DRAW_MODE mode = _DRAW_OR);
+	void draw_circle(int16_t x0, int16_t y0, uint16_t radius);
+	void draw_fill_circle(int16_t x0, int16_t y0, uint16_t radius, DRAW_MODE mode = _DRAW_OR);
+	void draw_bitmap(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, RASTER_OP op = _ROP_COPY,
+	                 const uint8_t *pMask = 0);
+#if !SSD1306_TILED
+	void copy_region(int16_t src_x, int16_t src_y, uint16_t width, uint16_t height, int16_t x, int16_t y);
+	const uint8_t *draw_frame(const uint8_t *pFrame);
+	void init_chart(StripChart &Chart, uint8_t x, uint8_t y, uint8_t width, uint8_t height, int16_t min, int16_t max);
+	void chart_sample(StripChart &Chart, int16_t value);
+#endif
 	char write_char(char ch, FontDef Font);
 	char write_string(const char* str, FontDef Font);
+	char write_char(char ch, const PageFontDef &Font);
+	char write_string(const char* str, const PageFontDef &Font);
 	void set_font(FONT font);
+	void init_number(NumberField &Field, int16_t x, int16_t y, const FontDef &Font, uint8_t width, uint8_t decimals = 0, bool bRightAlign = true);
+	void init_number(NumberField &Field, int16_t x, int16_t y, const PageFontDef &Font, uint8_t width, uint8_t decimals = 0, bool bRightAlign = true);
+	void draw_number(NumberField &Field, int32_t value);
+#if SSD1306_CONSOLE
+	void set_console(bool bOn);
+	void console_write(const char *str);
+#endif
+	bool display_list_overflow() const;
+	void set_contrast(uint8_t contrast);
+	uint8_t get_contrast() const;
+	void set_inverse(bool bInverse);
+	void set_display_on(bool bOn);
+	void fade(uint8_t contrast, uint16_t duration, FADE_CURVE curve = _FADE_SQUARE);
+	void blink(SCREEN_EFFECT effect, uint16_t period, uint8_t count = 0);
+	void stop_effect();
+	bool effect_tick();
+	void invert_region(int16_t x, int16_t y, uint16_t width, uint16_t height);
 	
 	SSD1306_oled& operator << (const char ch);
 	SSD1306_oled& operator << (const char *pStr);
@@ -0,0 +1,129 @@
+/*
+ * ssd1306_bus.h
+ *
+ */
+
+#ifndef SSD1306_BUS_H_
+#define SSD1306_BUS_H_
+
+#include "ssd1306.h"
+
+// Maximum count of panels on one bus
+#ifndef SSD1306_BUS_PANELS
+#define SSD1306_BUS_PANELS 4
+#endif
+// Maximum data bytes of one bus transaction. Longer data goes in several transactions (the controller address
+// pointer goes on between them), so other panels get the bus in between
+#ifndef SSD1306_BUS_CHUNK
+#define SSD1306_BUS_CHUNK 128
+#endif
+// Time in ms a synchronous transaction busy-waits for the bus before it fails with HAL_BUSY, then the display keeps
+// its commands for the next transaction. The chunk on the wire must fit in it: 128 bytes take about 3.5 ms at 400 kHz,
+// more with a mux or at 100 kHz
+#ifndef SSD1306_BUS_WAIT
+#define SSD1306_BUS_WAIT 100
+#endif
+
+class SSD1306_bus_panel;
+
+// Scheduler of one I2C port shared by several panels, e.g. at 0x3C and 0x3D or behind a TCA9548A-like mux.
+// Asynchronous updates of the panels are queued and sent in chunks of SSD1306_BUS_CHUNK bytes, every chunk starts
+// from the completion of the previous one. The next chunk goes to the queued panel of the highest priority,
+// panels of the same priority take turns, so a big frame of one panel doesn't hold back a small update of another.
+// Both HAL_I2C_MemTxCpltCallback() and HAL_I2C_MasterTxCpltCallback() (for the mux) must call transfer_complete(),
+// HAL_I2C_ErrorCallback() must call transfer_error(). service() starts the updates which wait for their frame interval
+class SSD1306_bus
+{
+	// ==================================  Static constant private variables ========================================== //
+	static const uint8_t PANELS_COUNT = SSD1306_BUS_PANELS;
+	static const uint16_t CHUNK_SIZE = SSD1306_BUS_CHUNK;
+	static const uint8_t MUX_UNKNOWN = 0;                   // Mux channel mask before the first selection
+	static const uint8_t COMMAND_TO_SEND = 0x00;            // I2C mark for device if it is command to send
+	static const uint8_t DATA_TO_SEND = 0x40;               // I2C mark for device if it is data to send
+	static const uint32_t WAIT_TIMEOUT = SSD1306_BUS_WAIT;  // Time in ms a synchronous transaction waits for the bus
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// ==================================== Others private class members =========================================== //
+	I2C_HandleTypeDef *m_I2C_Port;                          // STM32 I2C port
+	uint16_t m_MuxAddress;                                  // Mux address, bit-shifted for 1 pos left, 0 if there is no mux
+	uint8_t m_MuxSelected;                                  // Channel mask the mux is set to
+	uint8_t m_MuxByte;                                      // Channel mask which is being sent to the mux
+	SSD1306_bus_panel *m_Panels[PANELS_COUNT];
+	uint8_t m_PanelsCount;
+	uint8_t m_LastServed;                                   // Panel of the last chunk, the turn goes on from it
+	SSD1306_bus_panel *m_pActive;                           // Panel which chunk is on the wire
+	uint16_t m_Chunk;                                       // Size of the chunk on the wire
+	bool m_MuxPhase;                                        // Mux selection is on the wire, the chunk goes next
+	volatile bool m_Busy;                                   // Bus is taken by a transaction or by the scheduler
+	volatile bool m_SyncWaiting;                            // Synchronous transaction waits, the bus is released after the current chunk
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	bool claim();
+	bool take();
+	void start_next();
+	SSD1306_bus_panel *pick();
+	HAL_StatusTypeDef start_chunk();
+	void fail(SSD1306_bus_panel &Panel);
+	bool attach(SSD1306_bus_panel &Panel);
+	void request();
+	HAL_StatusTypeDef select_mux(const SSD1306_bus_panel &Panel, uint32_t timeout);
+	HAL_StatusTypeDef write(SSD1306_bus_panel &Panel, bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout);
+	bool probe(SSD1306_bus_panel &Panel);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_bus(I2C_HandleTypeDef *hi2c, uint16_t mux_addr = 0);
+	void service();
+	bool is_busy() const;
+	void transfer_complete(I2C_HandleTypeDef *hi2c);
+	void transfer_error(I2C_HandleTypeDef *hi2c);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	friend class SSD1306_bus_panel;
+};
+
+// Transport of one panel on SSD1306_bus. Priority 0 is the lowest. Frame interval (ms) caps the rate
+// of asynchronous updates: a new one waits until the interval since the beginning of the previous one is over.
+// Synchronous updates go at once, when the bus is free
+class SSD1306_bus_panel : public SSD1306_transport
+{
+	// ==================================== Others private class members =========================================== //
+	SSD1306_bus &m_Bus;
+	uint16_t m_SSD1306_I2C_Address;                         // SSD1306 I2C address, bit-shifted for 1 pos left
+	GPIO_TypeDef* m_GPIO_Port;                              // STM32 GPIO port for reseting OLED
+	uint16_t m_GPIO_Pin;                                    // STM32 GPIO pin for reseting OLED
+	uint8_t m_MuxMask;                                      // Mux channel mask of the panel, 0 if it isn't behind the mux
+	uint8_t m_Priority;
+	uint16_t m_FrameInterval;
+	SSD1306_oled *m_pDisplay;
+	volatile bool m_Queued;                                 // Transaction waits for the bus
+	bool m_Data;                                            // |
+	uint8_t *m_pData;                                       // |
+	uint16_t m_Size;                                        // |
+	ASYNC_TRANSFER m_Mode;                                  // | Rest of the queued transaction
+	bool m_FrameStarted;                                    // First chunk of the current update is sent
+	uint32_t m_FrameBeg;                                    // Tick when the last update began
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	bool ready(uint32_t tick) const;
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_bus_panel(SSD1306_bus &Bus, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN, uint8_t priority = 0,
+	                  uint16_t frame_interval = 0, int8_t mux_channel = -1);
+	void attach(SSD1306_oled &Display);
+	bool probe();
+	void set_reset(bool bActive);
+	HAL_StatusTypeDef write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout);
+	HAL_StatusTypeDef write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode);
+	const void *handle() const;
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	friend class SSD1306_bus;
+};
+
+#endif /* SSD1306_BUS_H_ */
@@ -0,0 +1,93 @@
+/*
+ * ssd1306_queue.h
+ *
+ */
+
+#ifndef SSD1306_QUEUE_H_
+#define SSD1306_QUEUE_H_
+
+#include <atomic>
+
+#include "ssd1306.h"
+
+// Count of producer lanes, every task or ISR which posts commands owns one
+#ifndef SSD1306_QUEUE_LANES
+#define SSD1306_QUEUE_LANES 2
+#endif
+// Commands of one lane, power of two up to 128
+#ifndef SSD1306_QUEUE_DEPTH
+#define SSD1306_QUEUE_DEPTH 8
+#endif
+#if SSD1306_QUEUE_DEPTH & (SSD1306_QUEUE_DEPTH - 1) || SSD1306_QUEUE_DEPTH > 128
+#error "SSD1306: queue depth must be a power of two up to 128"
+#endif
+
+enum QUEUE_COMMAND {_QCMD_TEXT, _QCMD_NUMBER, _QCMD_PIXEL, _QCMD_LINE, _QCMD_RECTANGLE, _QCMD_FILL_RECTANGLE};
+
+// Draw commands posted by several tasks and ISRs and drawn by one render task, which owns SSD1306_oled.
+// Every producer has its own lane, a single-producer single-consumer ring, so posting never blocks and needs
+// only atomic loads and stores of the indexes (Cortex-M0 has no exclusive access instructions for lock-free
+// multi-producer rings). Full lane drops the command and counts it. render(true) commits asynchronously only
+// with SSD1306_DOUBLE_BUFFER, otherwise the drawing of the next render() would tear the frame on the wire
+// and the commit is synchronous
+class SSD1306_queue
+{
+	// ==================================  Static constant private variables ========================================== //
+	static const uint8_t LANES_COUNT = SSD1306_QUEUE_LANES;
+	static const uint8_t LANE_DEPTH = SSD1306_QUEUE_DEPTH;
+	static const uint8_t TEXT_SIZE = 12;                    // Maximum text length of a command with the null-byte
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	struct Command
+	{
+		uint8_t m_Type;                                       // QUEUE_COMMAND
+		uint8_t m_Arg;                                        // FONT of text and numbers, DRAW_MODE of filled rectangles
+		uint8_t m_Width;                                      // |
+		uint8_t m_Decimals;                                   // | Numeric field, see SSD1306_oled::init_number()
+		int16_t m_X0;                                         // |
+		int16_t m_Y0;                                         // |
+		int16_t m_X1;                                         // |
+		int16_t m_Y1;                                         // | Coordinates, or x, y, width and height of rectangles
+		union
+		{
+			int32_t m_Value;
+			char m_Text[TEXT_SIZE];
+		};
+	};
+
+	private:
+	// ==================================== Others private class members =========================================== //
+	struct Lane
+	{
+		Command m_Ring[LANE_DEPTH];
+		std::atomic<uint8_t> m_Head;                          // Next command to post, written by the producer only
+		std::atomic<uint8_t> m_Tail;                          // Next command to draw, written by the render task only
+		std::atomic<uint16_t> m_Dropped;                      // Commands lost because the lane was full
+	};
+
+	SSD1306_oled &m_Display;
+	Lane m_Lanes[LANES_COUNT];
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	static Command make(QUEUE_COMMAND type, int16_t x0, int16_t y0, int16_t x1 = 0, int16_t y1 = 0);
+	void draw(const Command &Cmd);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_queue(SSD1306_oled &Display);
+	bool post(uint8_t lane, const Command &Cmd);
+	bool post_text(uint8_t lane, int16_t x, int16_t y, FONT font, const char *pText);
+	bool post_number(uint8_t lane, int16_t x, int16_t y, FONT font, int32_t value, uint8_t width, uint8_t decimals = 0);
+	bool post_pixel(uint8_t lane, int16_t x, int16_t y);
+	bool post_line(uint8_t lane, int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+	bool post_rectangle(uint8_t lane, int16_t x, int16_t y, uint16_t width, uint16_t height);
+	bool post_fill_rectangle(uint8_t lane, int16_t x, int16_t y, uint16_t width, uint16_t height, DRAW_MODE mode = _DRAW_OR);
+	uint16_t dropped(uint8_t lane) const;
+	uint16_t render(bool bAsync = false);
+	// ------------------------------------------------------------------------------------------------------------- //
+};
+
+#endif /* SSD1306_QUEUE_H_ */
@@ -0,0 +1,88 @@
+/*
+ * ssd1306_transport.h
+ *
+ */
+
+#ifndef SSD1306_TRANSPORT_H_
+#define SSD1306_TRANSPORT_H_
+
+#include "stm32f0xx_hal.h"
+
+class SSD1306_oled;
+
+enum ASYNC_TRANSFER {_DMA_TRANSFER, _IT_TRANSFER};
+
+// Bus between SSD1306_oled and the controller. Every transaction is either a command stream or display data,
+// the drawing core doesn't know how the bus tells them apart. Asynchronous transactions are finished
+// by SSD1306_oled::transfer_complete() or transfer_error() called with handle() from the HAL callbacks
+class SSD1306_transport
+{
+	public:
+	virtual ~SSD1306_transport() {}
+	virtual void attach(SSD1306_oled &) {}                  // Display which uses the transport
+	virtual bool probe() = 0;                               // Controller is there and may be configured
+	virtual void set_reset(bool bActive) = 0;               // Drives the reset pin of the controller
+	virtual HAL_StatusTypeDef write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout) = 0;
+	virtual HAL_StatusTypeDef write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode) = 0;
+	virtual void complete() {}                              // Asynchronous transaction is over, successfully or not
+	virtual const void *handle() const = 0;                 // HAL handle, which the HAL callbacks are matched by
+};
+
+// I2C bus: every transaction is the control byte (0x00 for commands, 0x40 for data) followed by the bytes
+class SSD1306_i2c : public SSD1306_transport
+{
+	// ==================================  Static constant private variables ========================================== //
+	static const uint8_t COMMAND_TO_SEND = 0x00;            // I2C mark for device if it is command to send
+	static const uint8_t DATA_TO_SEND = 0x40;               // I2C mark for device if it is data to send
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// ==================================== Others private class members =========================================== //
+	I2C_HandleTypeDef *m_I2C_Port;                          // STM32 I2C port
+	uint16_t m_SSD1306_I2C_Address;                         // SSD1306 I2C address, bit-shifted for 1 pos left
+	GPIO_TypeDef* m_GPIO_Port;                              // STM32 GPIO port for reseting OLED
+	uint16_t m_GPIO_Pin;                                    // STM32 GPIO pin for reseting OLED
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_i2c(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN);
+	bool probe();
+	void set_reset(bool bActive);
+	HAL_StatusTypeDef write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout);
+	HAL_StatusTypeDef write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode);
+	const void *handle() const;
+	// ------------------------------------------------------------------------------------------------------------- //
+};
+
+// 4-wire SPI bus: the D/C pin is low for commands and high for data. Chip select goes low for every transaction
+// and high after it, so other devices may share the bus. GPIO port 0 means the pin isn't wired (e.g. CS tied low)
+class SSD1306_spi : public SSD1306_transport
+{
+	// ==================================== Others private class members =========================================== //
+	SPI_HandleTypeDef *m_SPI_Port;                          // STM32 SPI port
+	GPIO_TypeDef* m_DC_Port;                                // |
+	uint16_t m_DC_Pin;                                      // | Data/command pin
+	GPIO_TypeDef* m_CS_Port;                                // |
+	uint16_t m_CS_Pin;                                      // | Chip select pin, active low
+	GPIO_TypeDef* m_Reset_Port;                             // |
+	uint16_t m_Reset_Pin;                                   // | Reset pin, active low
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	void select(bool bData);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_spi(SPI_HandleTypeDef *hspi, GPIO_TypeDef* DC_GPIOx, uint16_t DC_GPIO_PIN, GPIO_TypeDef* CS_GPIOx, uint16_t CS_GPIO_PIN,
+	            GPIO_TypeDef* Reset_GPIOx, uint16_t Reset_GPIO_PIN);
+	bool probe();
+	void set_reset(bool bActive);
+	HAL_StatusTypeDef write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout);
+	HAL_StatusTypeDef write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode);
+	void complete();
+	const void *handle() const;
+	// ------------------------------------------------------------------------------------------------------------- //
+};
+
+#endif /* SSD1306_TRANSPORT_H_ */
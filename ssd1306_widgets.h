@@ -0,0 +1,89 @@
+/*
+ * ssd1306_widgets.h
+ *
+ */
+
+#ifndef SSD1306_WIDGETS_H_
+#define SSD1306_WIDGETS_H_
+
+#include "ssd1306.h"
+
+// Size of the widget pool of a scene
+#ifndef SSD1306_WIDGETS_COUNT
+#define SSD1306_WIDGETS_COUNT 16
+#endif
+
+enum WIDGET_TYPE {_WIDGET_NONE, _WIDGET_LABEL, _WIDGET_BAR, _WIDGET_GAUGE, _WIDGET_ICON};
+
+// Retained scene of widgets on top of SSD1306_oled. Widgets live in a fixed pool and are referred to by their ids,
+// later widgets are drawn over earlier ones. Changing a widget only damages its bounds, render() redraws the damaged
+// rectangles (overlapping ones are joined) clipped to them and transmits just these rectangles
+class SSD1306_scene
+{
+	// ==================================  Static constant private variables ========================================== //
+	static const uint8_t WIDGETS_COUNT = SSD1306_WIDGETS_COUNT;
+	static const uint8_t DAMAGE_RECTS_COUNT = 8;            // Maximum count of separate damaged rectangles, the rest are joined
+	static const uint8_t LABEL_SIZE = 16;                   // Maximum label length with the null-byte
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// ==================================== Others private class members =========================================== //
+	struct Widget
+	{
+		WIDGET_TYPE m_Type;
+		bool m_Visible;
+		int16_t m_X;                                          // |
+		int16_t m_Y;                                          // |
+		uint16_t m_Width;                                     // |
+		uint16_t m_Height;                                    // | Bounds of the widget
+		int16_t m_Value;                                      // |
+		int16_t m_Max;                                        // | Bar and gauge value 0...m_Max
+		const FontDef *m_pFont;                               // |
+		char m_Text[LABEL_SIZE];                              // | Label
+		const uint8_t *m_pImage;                              // |
+		const uint8_t *m_pMask;                               // | Icon, see SSD1306_oled::draw_bitmap()
+	};
+
+	struct Rect                                             // Inclusive rectangle
+	{
+		int16_t m_X0;
+		int16_t m_Y0;
+		int16_t m_X1;
+		int16_t m_Y1;
+	};
+
+	SSD1306_oled &m_Display;
+	Widget m_Widgets[WIDGETS_COUNT];
+	Rect m_Damage[DAMAGE_RECTS_COUNT];                      // Damaged rectangles which don't overlap each other
+	uint8_t m_DamageCount;
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	// =================================== Private class member functions ========================================== //
+	int8_t add(WIDGET_TYPE type, int16_t x, int16_t y, uint16_t width, uint16_t height);
+	bool valid(int8_t id) const;
+	void damage_widget(int8_t id);
+	void draw_widget(const Widget &W, const Rect &Clip);
+	void draw_gauge(const Widget &W);
+	static bool touch(const Rect &A, const Rect &B);
+	static Rect join(const Rect &A, const Rect &B);
+	static int32_t area(const Rect &R);
+	// ------------------------------------------------------------------------------------------------------------- //
+
+	public:
+	// =================================== Public class member functions ========================================== //
+	SSD1306_scene(SSD1306_oled &Display);
+	int8_t add_label(int16_t x, int16_t y, const FontDef &Font, const char *pText);
+	int8_t add_bar(int16_t x, int16_t y, uint16_t width, uint16_t height, int16_t max);
+	int8_t add_gauge(int16_t x, int16_t y, uint16_t radius, int16_t max);
+	int8_t add_icon(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, const uint8_t *pMask = 0);
+	void remove(int8_t id);
+	void set_text(int8_t id, const char *pText);
+	void set_value(int8_t id, int16_t value);
+	void set_visible(int8_t id, bool bVisible);
+	void move(int8_t id, int16_t x, int16_t y);
+	void damage(int16_t x, int16_t y, uint16_t width, uint16_t height);
+	void damage_all();
+	void render();
+	// ------------------------------------------------------------------------------------------------------------- //
+};
+
+#endif /* SSD1306_WIDGETS_H_ */
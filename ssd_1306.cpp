@@ -1,414 +1,2336 @@
 
 #include "ssd1306.h"
 
-SSD1306_oled::SSD1306_oled(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN):
-		m_I2C_Port(hi2c),	m_SSD1306_I2C_Address(i2c_addr << 1), m_GPIO_Port(GPIOx), m_GPIO_Pin(GPIO_PIN), m_InitState(0)
+SSD1306_oled::SSD1306_oled(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN, bool bDeferInit):
+		m_I2C(hi2c, i2c_addr, GPIOx, GPIO_PIN), m_pTransport(&m_I2C)
 	{
-		m_pBuffer = new uint8_t[BUFFER_SIZE];
-		memset(m_pBuffer, 0, BUFFER_SIZE);
-		ssd1306_Init();
-		m_DefFont = _7x10;
+		setup(bDeferInit);
+	}
+	
+	// Display on another bus, e.g. SSD1306_spi. The transport must outlive the object
+	SSD1306_oled::SSD1306_oled(SSD1306_transport &Transport, bool bDeferInit):
+		m_I2C(0, 0, 0, 0), m_pTransport(&Transport)
+	{
+		setup(bDeferInit);
 	}
 	
 	SSD1306_oled:: ~SSD1306_oled()
 	{
-		if(m_pBuffer)
-			delete [] m_pBuffer;
+		wait();
+	}
+	
+	void SSD1306_oled::setup(bool bDeferInit)
+	{
+		m_InitState = 0;
+		m_InitStep = _INIT_IDLE;
+		m_InitWake = m_InitBeg = m_InitLatency = 0;
+		m_WarmRestart = false;
+		m_CurX = m_CurY = 0;
+		m_ClipX0 = m_ClipY0 = 0;
+		m_ClipX1 = DISPLAY_WIDTH - 1;
+		m_ClipY1 = DISPLAY_HEIGHT - 1;
+		m_StartLine = 0;
+		m_HwScroll = false;
+#if SSD1306_CONSOLE
+		m_Console = false;
+		m_ConsoleY = 0;
+#endif
+		m_TxBusy = false;
+		m_TxMode = _DMA_TRANSFER;
+		m_pTxCallback = 0;
+		m_CmdCount = 0;
+		memset(&m_Stats, 0, sizeof(m_Stats));
+		m_FrameInterval = 0;
+		m_LastFrame = 0;
+		m_FramePending = false;
+		m_PacedAsync = false;
+		m_Contrast = 128;
+		m_Inverse = false;
+		m_DisplayOn = true;
+		m_Fading = m_Blinking = false;
+#if SSD1306_TILED
+		m_ListSize = 0;
+		m_LastText = NO_TEXT_RECORD;
+		m_ListFontsCount = 0;
+		m_ListPageFontsCount = 0;
+		m_ListOverflow = false;
+		m_Replaying = false;
+		m_BufPage = 0;
+#endif
+		memset(m_Buffer, 0, BUFFER_SIZE);
+		mark_clean();
+		m_DefFont = _7x10;
+		m_pTransport->attach(*this);
+		if(!bDeferInit)
+			ssd1306_Init();
+	}
+
+	// Command bytes are collected and sent as one command stream (one transaction of the transport)
+	// by i2c_FlushCommands(), which is also done before every data transfer
+	void SSD1306_oled::i2c_WriteCommand(uint8_t nCommand)
+	{
+		if(COMMAND_BATCH_SIZE == m_CmdCount && HAL_BUSY == i2c_FlushCommands())
+			m_CmdCount = 0;                                    // Bus stays busy and the batch can't grow
+		m_CmdBatch[m_CmdCount++] = nCommand;
+	}
+	
+	// HAL_BUSY means the bus wasn't taken and nothing was sent (e.g. another panel of SSD1306_bus holds it),
+	// then the batch is kept and goes with the next flush. After other errors the batch is dropped
+	HAL_StatusTypeDef SSD1306_oled::i2c_FlushCommands()
+	{
+		if(!m_CmdCount)
+			return HAL_OK;
+		
+		wait();
+		HAL_StatusTypeDef status = bus_write(false, m_CmdBatch, m_CmdCount, COMMAND_SEND_TIMEOUT);
+		if(HAL_BUSY != status)
+			m_CmdCount = 0;
+		
+		return status;
+	}
+	
+	void SSD1306_oled::i2c_WriteData(uint8_t *pData, uint16_t nSize)
+	{
+		if(HAL_BUSY == i2c_FlushCommands())                  // Data would go without its address window
+			return;
+		wait();
+		bus_write(true, pData, nSize, 10 * COMMAND_SEND_TIMEOUT);
+	}
+	
+	// Synchronous transaction, its bytes and its duration go to the bus counters
+	HAL_StatusTypeDef SSD1306_oled::bus_write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout)
+	{
+		uint32_t start = HAL_GetTick();
+		HAL_StatusTypeDef status = m_pTransport->write(bData, pData, nSize, timeout);
+		m_Stats.m_BlockedTicks += HAL_GetTick() - start;
+		count_write(bData, nSize, status);
+		
+		return status;
+	}
+	
+	void SSD1306_oled::count_write(bool bData, uint16_t nSize, HAL_StatusTypeDef status)
+	{
+		if(HAL_OK != status)
+			return;
+		
+		++m_Stats.m_Transactions;
+		if(bData)
+			m_Stats.m_DataBytes += nSize;
+		else
+			m_Stats.m_CommandBytes += nSize;
+	}
+	
+// Returns the buffer row of the page or 0 if the page is not held in m_Buffer now (page-tiled rendering)
+uint8_t inline *SSD1306_oled::page_ptr(uint8_t page)
+{
+#if SSD1306_TILED
+	return page == m_BufPage ? m_Buffer : 0;
+#else
+	return m_Buffer + page * DISPLAY_WIDTH;
+#endif
+}
+
+static inline void apply_mask(uint8_t *pData, uint8_t mask, DRAW_MODE mode)
+{
+	switch(mode)
+	{
+		case _DRAW_OR:    *pData |= mask;  break;
+		case _DRAW_CLEAR: *pData &= ~mask; break;
+		case _DRAW_XOR:   *pData ^= mask;  break;
+	}
+}
+
+// Word type which may alias the uint8_t buffer, so the compiler doesn't reorder the byte and the word accesses
+typedef uint32_t __attribute__((may_alias)) buffer_word;
+
+// Applies the mask to count bytes. Bytes up to the first word boundary and after the last one are done
+// one by one, the rest by aligned 32-bit words with the mask repeated in every byte
+static void fill_bytes(uint8_t *pData, uint16_t count, uint8_t mask, DRAW_MODE mode)
+{
+	uint32_t wordMask = mask * 0x01010101UL;
+	
+	for( ; count && ((uintptr_t)pData & 3); --count, ++pData)
+		apply_mask(pData, mask, mode);
+	
+	buffer_word *pWord = (buffer_word *)pData;                // Aligned by the loop above
+	switch(mode)
+	{
+		case _DRAW_OR:
+			for( ; count >= 4; count -= 4)
+				*pWord++ |= wordMask;
+		break;
+		case _DRAW_CLEAR:
+			for( ; count >= 4; count -= 4)
+				*pWord++ &= ~wordMask;
+		break;
+		case _DRAW_XOR:
+			for( ; count >= 4; count -= 4)
+				*pWord++ ^= wordMask;
+		break;
+	}
+	
+	for(pData = (uint8_t *)pWord; count; --count, ++pData)
+		apply_mask(pData, mask, mode);
+}
+
+// Span fill core. Fills the rectangle clipped by the clip rectangle going page by page: the top and the bottom pages
+// get partial masks, the interior pages are written with whole bytes. Every buffer byte is touched once
+void SSD1306_oled::fill_span(int32_t x, int32_t y, int32_t width, int32_t height, DRAW_MODE mode)
+{
+	int32_t xEnd = x + width - 1, yEnd = y + height - 1;
+	
+	if(width <= 0 || height <= 0 || !clip_box(x, y, xEnd, yEnd))
+		return;
+	mark_dirty(x, y, xEnd, yEnd);
+	
+	for(uint8_t page = y >> 3; page <= (yEnd >> 3); ++page)
+	{
+		uint8_t *bufferPtr = page_ptr(page);
+		if(!bufferPtr)
+			continue;
+		
+		uint8_t mask = 0xFF;
+		if(page == (y >> 3))
+			mask &= 0xFF << (y & 7);                             // Top partial page
+		if(page == (yEnd >> 3))
+			mask &= 0xFF >> (7 - (yEnd & 7));                    // Bottom partial page
+		fill_bytes(bufferPtr + x, xEnd - x + 1, mask, mode);
+	}
+}
+
+// First Bresenham step where the minor axis offset reaches n > 0, see clip_line()
+static int32_t first_step(int32_t n, int32_t dx, int32_t dy, int32_t e0)
+{
+	return (int32_t)(((int64_t)(n - 1) * dx + e0) / dy) + 1;
+}
+
+// Count of minor axis steps made by a line during the next steps along the major axis
+static int32_t minor_steps(int32_t err, int32_t dx, int32_t dy, int32_t steps)
+{
+	int64_t shift = (int64_t)steps * dy - err;
+	return shift > 0 ? (int32_t)((shift + dx - 1) / dx) : 0;
+}
+
+// Clips the line of draw_line() to the rectangle without moving its pixels. draw_line() steps k = 0...dx along
+// the major axis starting with error term e0 = dx / 2, so the minor axis offset after k steps is
+// n(k) = max(0, ceil((k * dy - e0) / dx)). It lets the first and the last visible steps and the error term
+// at the first one be found at once instead of walking the invisible part. Returns false if nothing is visible
+bool SSD1306_oled::clip_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t xMin, int16_t yMin, int16_t xMax, int16_t yMax, LineStepper &line)
+{
+	line.m_Steep = abs(y1 - y0) > abs(x1 - x0);
+	if(line.m_Steep)
+	{
+		SWAP_INT16_T(x0, y0);
+		SWAP_INT16_T(x1, y1);
+		SWAP_INT16_T(xMin, yMin);
+		SWAP_INT16_T(xMax, yMax);
+	}
+	if(x0 > x1)
+	{
+		SWAP_INT16_T(x0, x1);
+		SWAP_INT16_T(y0, y1);
+	}
+	
+	int32_t dx = x1 - x0, dy = abs(y1 - y0), e0 = dx / 2;
+	int8_t yStep = y0 < y1 ? 1 : -1;
+	
+	int32_t kBeg = xMin - x0 > 0 ? xMin - x0 : 0;
+	int32_t kEnd = xMax - x0 < dx ? xMax - x0 : dx;
+	int32_t nLo = yStep > 0 ? yMin - y0 : y0 - yMax;                  // Visible minor axis offsets
+	int32_t nHi = yStep > 0 ? yMax - y0 : y0 - yMin;
+	if(kBeg > kEnd || nHi < 0 || (!dy && nLo > 0))
+		return false;
+	if(dy)
+	{
+		if(nLo > 0 && first_step(nLo, dx, dy, e0) > kBeg)
+			kBeg = first_step(nLo, dx, dy, e0);
+		if(first_step(nHi + 1, dx, dy, e0) - 1 < kEnd)
+			kEnd = first_step(nHi + 1, dx, dy, e0) - 1;
+		if(kBeg > kEnd)
+			return false;
+	}
+	
+	int32_t n = minor_steps(e0, dx, dy, kBeg);
+	line.m_Major = x0 + kBeg;
+	line.m_MajorEnd = x0 + kEnd;
+	line.m_Minor = y0 + yStep * n;
+	line.m_MinorStep = yStep;
+	line.m_Err = (int32_t)((int64_t)n * dx + e0 - (int64_t)kBeg * dy);
+	line.m_Dx = dx;
+	line.m_Dy = dy;
+	
+	return true;
+}
+
+// Collects the leftmost and the rightmost column of every row of the line, which is stepped exactly like draw_line().
+// Only the rows inside the clip rectangle are taken. Columns out of the clip rectangle are clipped by fill_rows(),
+// so the parts of a flat line beyond the left or the right edge aren't walked: their rows just get the column
+// next to the edge
+void SSD1306_oled::line_spans(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t *pMin, int16_t *pMax)
+{
+	LineStepper line;
+	bool bSteep = abs(y1 - y0) > abs(x1 - x0);
+	
+	if(!bSteep)
+	{
+		int16_t sides[][3] = {{INT16_MIN, (int16_t)(m_ClipX0 - 1), (int16_t)(m_ClipX0 - 1)},
+		                      {(int16_t)(m_ClipX1 + 1), INT16_MAX, (int16_t)(m_ClipX1 + 1)}};
+		for(uint8_t side = 0; side < 2; ++side)
+		{
+			if(!clip_line(x0, y0, x1, y1, sides[side][0], m_ClipY0, sides[side][1], m_ClipY1, line))
+				continue;
+			
+			int16_t rowEnd = line.m_Minor + line.m_MinorStep * minor_steps(line.m_Err, line.m_Dx, line.m_Dy, line.m_MajorEnd - line.m_Major);
+			for(int16_t row = line.m_Minor; ; row += line.m_MinorStep)
+			{
+				if(sides[side][2] < pMin[row])
+					pMin[row] = sides[side][2];
+				if(sides[side][2] > pMax[row])
+					pMax[row] = sides[side][2];
+				if(row == rowEnd)
+					break;
+			}
+		}
+	}
+	
+	if(!clip_line(x0, y0, x1, y1, bSteep ? INT16_MIN : m_ClipX0, m_ClipY0, bSteep ? INT16_MAX : m_ClipX1, m_ClipY1, line))
+		return;
+	
+	for( ; line.m_Major <= line.m_MajorEnd; ++line.m_Major)
+	{
+		int16_t px = line.m_Steep ? line.m_Minor : line.m_Major, py = line.m_Steep ? line.m_Major : line.m_Minor;
+		if(px < pMin[py])
+			pMin[py] = px;
+		if(px > pMax[py])
+			pMax[py] = px;
+		
+		line.m_Err -= line.m_Dy;
+		if(line.m_Err < 0)
+		{
+			line.m_Minor += line.m_MinorStep;
+			line.m_Err += line.m_Dx;
+		}
+	}
+}
+
+// Page-span rasterizer. Fills the row spans pMin[y]...pMax[y] (empty if pMin[y] > pMax[y]) clipped by the clip rectangle
+// going page by page: the spans of the 8 rows of the page are turned into bit toggles at their first and after their
+// last columns, so one pass along the page gives the mask of every column and every buffer byte is written once
+void SSD1306_oled::fill_rows(const int16_t *pMin, const int16_t *pMax, DRAW_MODE mode)
+{
+	uint8_t toggles[DISPLAY_WIDTH + 1];
+	
+	for(uint8_t page = 0; page < PAGES_COUNT; ++page)
+	{
+		uint8_t *bufferPtr = page_ptr(page);
+		if(!bufferPtr)
+			continue;
+		
+		int16_t pPageMin[8], pPageMax[8];
+		int16_t xBeg = DISPLAY_WIDTH, xEnd = -1;
+		for(uint8_t bit = 0; bit < 8; ++bit)
+		{
+			pPageMin[bit] = pMin[page * 8 + bit] > m_ClipX0 ? pMin[page * 8 + bit] : m_ClipX0;
+			pPageMax[bit] = pMax[page * 8 + bit] < m_ClipX1 ? pMax[page * 8 + bit] : m_ClipX1;
+			if(pPageMin[bit] > pPageMax[bit])
+				continue;
+			if(pPageMin[bit] < xBeg)
+				xBeg = pPageMin[bit];
+			if(pPageMax[bit] > xEnd)
+				xEnd = pPageMax[bit];
+		}
+		if(xBeg > xEnd)
+			continue;
+		
+		memset(toggles + xBeg, 0, xEnd - xBeg + 2);
+		for(uint8_t bit = 0; bit < 8; ++bit)
+		{
+			if(pPageMin[bit] > pPageMax[bit])
+				continue;
+			toggles[pPageMin[bit]] ^= 1 << bit;
+			toggles[pPageMax[bit] + 1] ^= 1 << bit;
+		}
+		
+		mark_dirty(xBeg, page * 8, xEnd, page * 8);
+		uint8_t mask = 0;
+		for(int16_t x = xBeg; x <= xEnd; ++x)
+		{
+			mask ^= toggles[x];
+			apply_mask(bufferPtr + x, mask, mode);
+		}
+	}
+}
+
+static inline uint8_t raster_op(uint8_t dst, uint8_t src, RASTER_OP op)
+{
+	switch(op)
+	{
+		case _ROP_OR:     return dst | src;
+		case _ROP_AND:    return dst & src;
+		case _ROP_XOR:    return dst ^ src;
+		case _ROP_INVERT: return ~src;
+		default:          return src;
+	}
+}
+
+// Draws the page-oriented image byte by byte. Image is pages of width column bytes which are stride bytes apart,
+// bit 0 is the top row of a page and the image begins from the bit row_offset of the first page. For y not aligned
+// to the image rows every buffer byte is put together from two image pages by one shift. The optional mask has
+// the image layout, buffer pixels under its zero bits are left as they are. Image may lie in m_Buffer itself,
+// then pages and columns are walked so that every source byte is read before it is overwritten
+void SSD1306_oled::blit(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pData, uint16_t stride, uint8_t row_offset,
+                        const uint8_t *pMask, RASTER_OP op)
+{
+	int32_t xBeg = x, yBeg = y, xEnd = x + width - 1, yEnd = y + height - 1;
+	if(!width || !height || !clip_box(xBeg, yBeg, xEnd, yEnd))
+		return;
+	mark_dirty(xBeg, yBeg, xEnd, yEnd);
+	
+	bool bBottomUp = false, bRightToLeft = false;
+	if(pData >= m_Buffer && pData < m_Buffer + BUFFER_SIZE)
+	{
+		int32_t offset = pData - m_Buffer;
+		bBottomUp = y > (offset / DISPLAY_WIDTH) * 8 + row_offset;
+		bRightToLeft = x > offset % DISPLAY_WIDTH;
+	}
+	
+	int32_t imagePages = (row_offset + height + 7) >> 3;
+	int8_t pageStep = bBottomUp ? -1 : 1, colStep = bRightToLeft ? -1 : 1;
+	for(int32_t page = bBottomUp ? yEnd >> 3 : yBeg >> 3, pages = (yEnd >> 3) - (yBeg >> 3) + 1; pages; --pages, page += pageStep)
+	{
+		uint8_t *pDst = page_ptr(page);
+		if(!pDst)
+			continue;
+		
+		uint8_t rowsMask = 0xFF;
+		if(page == (yBeg >> 3))
+			rowsMask &= 0xFF << (yBeg & 7);
+		if(page == (yEnd >> 3))
+			rowsMask &= 0xFF >> (7 - (yEnd & 7));
+		
+		int32_t row = page * 8 - y + row_offset;                         // Image row at the top of the page, -7 at least
+		int32_t imagePage = row < 0 ? -1 : row >> 3;
+		uint8_t shift = row - imagePage * 8;
+		bool bLow = imagePage >= 0, bHigh = imagePage + 1 < imagePages;  // Image pages above and below the page boundary
+		int32_t low = imagePage * stride - x, high = low + stride;        // Offsets of the column x in the two image pages
+		
+		for(int32_t col = bRightToLeft ? xEnd : xBeg, cols = xEnd - xBeg + 1; cols; --cols, col += colStep)
+		{
+			uint8_t bits = ((bLow ? pData[low + col] : 0) | (bHigh ? pData[high + col] << 8 : 0)) >> shift;
+			uint8_t mask = rowsMask;
+			if(pMask)
+				mask &= ((bLow ? pMask[low + col] : 0) | (bHigh ? pMask[high + col] << 8 : 0)) >> shift;
+			pDst[col] = (pDst[col] & ~mask) | (raster_op(pDst[col], bits, op) & mask);
+		}
+	}
+}
+
+// Intersects the box with the clip rectangle. Returns false if nothing is left, so the primitive is rejected at once
+bool SSD1306_oled::clip_box(int32_t &x_beg, int32_t &y_beg, int32_t &x_end, int32_t &y_end)
+{
+	if(x_beg > m_ClipX1 || y_beg > m_ClipY1 || x_end < m_ClipX0 || y_end < m_ClipY0)
+		return false;
+	
+	if(x_beg < m_ClipX0)
+		x_beg = m_ClipX0;
+	if(y_beg < m_ClipY0)
+		y_beg = m_ClipY0;
+	if(x_end > m_ClipX1)
+		x_end = m_ClipX1;
+	if(y_end > m_ClipY1)
+		y_end = m_ClipY1;
+	
+	return true;
+}
+
+// Sets or clears the pixel, which must be inside the clip rectangle
+void inline SSD1306_oled::put_pixel(int16_t x, int16_t y, bool bSet)
+{
+	uint8_t *bufferPtr = page_ptr(y >> 3);
+	if(!bufferPtr)
+		return;
+	
+	if(bSet)
+		bufferPtr[x] |= 1 << (y & 7);
+	else
+		bufferPtr[x] &= ~(1 << (y & 7));
+}
+
+void inline SSD1306_oled::plot(int16_t x, int16_t y)
+{
+	if(x >= m_ClipX0 && x <= m_ClipX1 && y >= m_ClipY0 && y <= m_ClipY1)
+		put_pixel(x, y, true);
+}
+
+// Box must be inside the screen. Rows below it are dropped, so an off-by-one of the caller can't write past the dirty spans
+void SSD1306_oled::mark_dirty(int16_t x_beg, int16_t y_beg, int16_t x_end, int16_t y_end)
+{
+	uint8_t lastPage = y_end >> 3 < PAGES_COUNT ? y_end >> 3 : PAGES_COUNT - 1;
+	
+	for(uint8_t page = y_beg >> 3; page <= lastPage; ++page)
+	{
+		if(x_beg < m_DirtyBeg[page])
+			m_DirtyBeg[page] = x_beg;
+		if(x_end > m_DirtyEnd[page])
+			m_DirtyEnd[page] = x_end;
+	}
+}
+
+void SSD1306_oled::mark_clean()
+{
+	memset(m_DirtyBeg, DISPLAY_WIDTH, PAGES_COUNT);
+	memset(m_DirtyEnd, 0, PAGES_COUNT);
+}
+
+// Marks the buffer byte at the offset from the buffer beginning
+void inline SSD1306_oled::mark_dirty_byte(uint16_t offset)
+{
+	uint8_t page = offset / DISPLAY_WIDTH, col = offset % DISPLAY_WIDTH;
+	
+	if(col < m_DirtyBeg[page])
+		m_DirtyBeg[page] = col;
+	if(col > m_DirtyEnd[page])
+		m_DirtyEnd[page] = col;
+}
+
+// Finds the next dirty window beginning from page. Consecutive fully changed pages are joined
+// into one window, because their data is contiguous in the buffer
+bool SSD1306_oled::next_window(const uint8_t *pBeg, const uint8_t *pEnd, uint8_t &page, uint8_t &lastPage)
+{
+	while(page < PAGES_COUNT && pBeg[page] > pEnd[page])
+		++page;
+	if(page >= PAGES_COUNT)
+		return false;
+	
+	lastPage = page;
+	if(0 == pBeg[page] && DISPLAY_WIDTH - 1 == pEnd[page])
+	{
+		while(lastPage + 1 < PAGES_COUNT && 0 == pBeg[lastPage + 1] && DISPLAY_WIDTH - 1 == pEnd[lastPage + 1])
+			++lastPage;
+	}
+	return true;
+}
+
+HAL_StatusTypeDef SSD1306_oled::tx_write(bool bData, uint8_t *pData, uint16_t nSize)
+{
+	HAL_StatusTypeDef status = m_pTransport->write_async(bData, pData, nSize, m_TxMode);
+	count_write(bData, nSize, status);
+	
+	return status;
+}
+
+// Starts the next transaction of the asynchronous transfer. Every window goes as two transactions:
+// the addressing command stream and then the window data. Returns false when nothing is left to send
+bool SSD1306_oled::tx_next()
+{
+	HAL_StatusTypeDef status;
+	
+	if(m_TxDataPhase)
+	{
+#if SSD1306_DOUBLE_BUFFER
+		uint8_t *pFrame = m_FrontBuffer;
+#else
+		uint8_t *pFrame = m_Buffer;
+#endif
+		status = tx_write(true, pFrame + m_TxPage * DISPLAY_WIDTH + m_TxBeg[m_TxPage],
+		                  (m_TxLastPage - m_TxPage) * DISPLAY_WIDTH + m_TxEnd[m_TxPage] - m_TxBeg[m_TxPage] + 1);
+		m_TxDataPhase = false;
+		m_TxPage = m_TxLastPage + 1;
+	}
+	else
+	{
+		if(!next_window(m_TxBeg, m_TxEnd, m_TxPage, m_TxLastPage))
+			return false;
+		
+		m_TxCmd[0] = SET_COLUMN_ADDRESS;
+		m_TxCmd[1] = m_TxBeg[m_TxPage] + COLUMN_OFFSET;
+		m_TxCmd[2] = m_TxEnd[m_TxPage] + COLUMN_OFFSET;
+		m_TxCmd[3] = SET_PAGE_ADDRESS;
+		m_TxCmd[4] = m_TxPage;
+		m_TxCmd[5] = m_TxLastPage;
+		m_TxDataPhase = true;
+		status = tx_write(false, m_TxCmd, sizeof(m_TxCmd));
+	}
+	
+	if(HAL_OK != status)
+	{
+		invalidate();                                        // Interrupted frame is sent again with the next update
+		return false;
+	}
+	
+	return true;
+}
+
+bool SSD1306_oled::start_async(bool bFullFrame, void (*pCallback)(SSD1306_oled &Obj))
+{
+#if SSD1306_TILED
+	(void)bFullFrame;
+	(void)pCallback;
+	return false;
+#else
+	if(m_TxBusy || !m_InitState || m_HwScroll)
+		return false;
+	
+	if(HAL_BUSY == i2c_FlushCommands())                    // Start line goes before the frame
+		return false;
+#if SSD1306_DOUBLE_BUFFER
+	memcpy(m_FrontBuffer, m_Buffer, BUFFER_SIZE);
+#endif
+	
+	if(bFullFrame)
+	{
+		memset(m_TxBeg, 0, PAGES_COUNT);
+		memset(m_TxEnd, DISPLAY_WIDTH - 1, PAGES_COUNT);
+	}
+	else
+	{
+		memcpy(m_TxBeg, m_DirtyBeg, PAGES_COUNT);
+		memcpy(m_TxEnd, m_DirtyEnd, PAGES_COUNT);
+	}
+	mark_clean();
+	
+	m_pTxCallback = pCallback;
+	m_TxPage = 0;
+	m_TxDataPhase = false;
+	m_TxBusy = true;
+	if(!tx_next())
+	{
+		m_TxBusy = false;
+		return false;
+	}
+	++m_Stats.m_Updates;
+	
+	return true;
+#endif
+}
+
+// Blocking initialization, which is kept for compatibility. It simply runs init_step() until it finishes
+uint8_t SSD1306_oled::ssd1306_Init(bool bWarmRestart)
+{
+	begin_init(bWarmRestart);
+	while(!init_step())
+		;
+	
+	return m_InitState;
+}
+
+// Starts the non-blocking initialization, which then goes on by init_step() calls. Warm restart is for the case
+// when the controller kept its configuration and power (e.g. MCU reset by watchdog): the power-up delay,
+// the GPIO reset and the clearing of the screen are skipped
+void SSD1306_oled::begin_init(bool bWarmRestart)
+{
+	wait();
+	m_InitState = 0;
+	m_WarmRestart = bWarmRestart;
+	m_InitBeg = HAL_GetTick();
+	if(bWarmRestart)
+		init_wait(_INIT_PROBE, 0);
+	else
+		init_wait(_INIT_POWER_UP, 500);
+}
+
+void SSD1306_oled::init_wait(INIT_STEP nextStep, uint32_t ms)
+{
+	m_InitStep = nextStep;
+	m_InitWake = HAL_GetTick() + ms;
+}
+
+// Does the next step of initialization if its delay has expired. Never blocks on delays, so it can be called
+// from the main loop or a timer tick together with other subsystems. Returns true when initialization is finished,
+// successfully or not (see is_initialized())
+bool SSD1306_oled::init_step()
+{
+	if(_INIT_IDLE == m_InitStep || _INIT_DONE == m_InitStep || _INIT_FAILED == m_InitStep)
+		return true;
+	if((int32_t)(HAL_GetTick() - m_InitWake) < 0)
+		return false;
+	
+	switch(m_InitStep)
+	{
+		case _INIT_POWER_UP:
+			init_wait(_INIT_PROBE, 0);
+		break;
+		case _INIT_PROBE:
+			if(!m_pTransport->probe())
+			{
+				m_InitLatency = HAL_GetTick() - m_InitBeg;
+				m_InitStep = _INIT_FAILED;
+				return true;
+			}
+			if(m_WarmRestart)
+				init_wait(_INIT_CONFIGURE, 0);
+			else
+				init_wait(_INIT_RESET_LOW, 200);
+		break;
+		case _INIT_RESET_LOW:
+			m_pTransport->set_reset(true);
+			init_wait(_INIT_RESET_HIGH, 10);
+		break;
+		case _INIT_RESET_HIGH:
+			m_pTransport->set_reset(false);
+			init_wait(_INIT_CONFIGURE, 110);
+		break;
+		case _INIT_CONFIGURE:
+			i2c_WriteCommand(DEACTIVATE_SCROLL);                                         // Scroll may be left running before a warm restart
+			m_HwScroll = false;
+			i2c_WriteCommand(SET_MULTIPLEX_RATIO);
+			i2c_WriteCommand(MULTIPLEX_RATIO);                                           // Display height - 1, 63 + 1 = 64 for 128x64 screen
+			i2c_WriteCommand(SET_DISPLAY_OFFSET);
+			i2c_WriteCommand(0x00);                                                      // Leave reset value, 0, without shifting
+			i2c_WriteCommand(SET_START_LINE | m_StartLine);                              // 0 unless the start line was set before
+			i2c_WriteCommand(SET_COLUMN_REFL_MAPPING);
+			i2c_WriteCommand(SET_COM_REFL_MAPPING);
+			i2c_WriteCommand(SET_COM_PIN_HW_CONF);                                       // Set COM Pins hardware configuration,
+			i2c_WriteCommand(COM_PIN_HW_CONF);                                           // sequential for 32 rows screens, alternative (reset value) otherwise
+			i2c_WriteCommand(SET_CONTRAST_CONTROL);
+			i2c_WriteCommand(m_Contrast);                                                // Middle value 128 unless set before
+			i2c_WriteCommand(RESUME_DISPLAY_RAM);                                        // Disable entire display on
+			i2c_WriteCommand(m_Inverse ? SET_DISPLAY_INVERSE : SET_DISPLAY_NORMAL);      // Normal unless set before, like the contrast
+			i2c_WriteCommand(SET_DISPLAY_CLOCK);
+			i2c_WriteCommand(240);                                                       // For frequency value 15 << 4 | prescaler 0 (+1 in fact)
+			i2c_WriteCommand(CHARGE_PUMP_SETTING);
+			i2c_WriteCommand(ENABLE_CHARGE_PUMP);
+			i2c_WriteCommand(SET_MEM_ADDRESS_MODE);
+			i2c_WriteCommand(_HORIS_ADDRESS_MODE);
+			i2c_WriteCommand(m_DisplayOn ? SET_DISPLAY_ON : SET_DISPLAY_OFF);            // On unless turned off before
+			i2c_FlushCommands();
+			m_InitState = 1;
+			if(m_WarmRestart)
+			{
+				invalidate();                                                            // Screen keeps old content, the next update_dirty() replaces it
+				m_InitLatency = HAL_GetTick() - m_InitBeg;
+				m_InitStep = _INIT_DONE;
+				return true;
+			}
+			init_wait(_INIT_CLEAR, 20);
+		break;
+		case _INIT_CLEAR:
+			send_screen();                                                             // Overwrites random GDDRAM content, keeps what was drawn meanwhile
+			m_InitLatency = HAL_GetTick() - m_InitBeg;
+			m_InitStep = _INIT_DONE;
+			return true;
+		default:
+		break;
+	}
+	
+	return false;
+}
+
+bool SSD1306_oled::is_initialized() const
+{
+	return m_InitState;
+}
+
+// Duration in ms of the last finished initialization, from begin_init() to the last step
+uint32_t SSD1306_oled::init_latency() const
+{
+	return m_InitLatency;
+}
+
+void SSD1306_oled::update_screen()
+{
+	if(!defer_update(true))
+		send_screen();
+}
+
+// Transmits only the changed column span of every dirty page
+void SSD1306_oled::update_dirty()
+{
+	if(!defer_update(false))
+		send_dirty();
+}
+
+void SSD1306_oled::send_screen()
+{
+	if(!m_InitState || m_HwScroll)
+		return;
+	
+	set_pos(0, 0, DISPLAY_WIDTH - 1, PAGES_COUNT - 1);
+#if SSD1306_TILED
+	for(uint8_t page = 0; page < PAGES_COUNT; ++page)                              // Address pointer goes on between transactions
+	{
+		replay(page);
+		i2c_WriteData(m_Buffer, DISPLAY_WIDTH);
+	}
+#else
+	i2c_WriteData(m_Buffer, BUFFER_SIZE);
+#endif
+	mark_clean();
+	++m_Stats.m_Updates;
+}
+
+void SSD1306_oled::send_dirty()
+{
+	if(!m_InitState || m_HwScroll)
+		return;
+	
+#if SSD1306_TILED
+	send_screen();                                                                 // Display list doesn't keep page coverage
+	return;
+#endif
+	for(uint8_t page = 0, lastPage = 0; next_window(m_DirtyBeg, m_DirtyEnd, page, lastPage); page = lastPage + 1)
+	{
+		set_pos(m_DirtyBeg[page], page, m_DirtyEnd[page], lastPage);
+		i2c_WriteData(m_Buffer + page * DISPLAY_WIDTH + m_DirtyBeg[page],
+		              (lastPage - page) * DISPLAY_WIDTH + m_DirtyEnd[page] - m_DirtyBeg[page] + 1);
+	}
+	i2c_FlushCommands();                                                           // Start line change may be left without any window
+	mark_clean();
+	++m_Stats.m_Updates;
+}
+
+// Transmits columns x...x + width - 1 of the pages which hold rows y...y + height - 1. Dirty spans inside
+// the region are not sent again by update_dirty()
+void SSD1306_oled::update_region(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+	if(!m_InitState || m_HwScroll)
+		return;
+	
+#if SSD1306_TILED
+	(void)x;
+	(void)y;
+	(void)width;
+	(void)height;
+	update_screen();                                                               // Display list doesn't keep page coverage
+	return;
+#else
+	int32_t xBeg = x < 0 ? 0 : x, yBeg = y < 0 ? 0 : y, xEnd = (int32_t)x + width - 1, yEnd = (int32_t)y + height - 1;
+	if(xEnd > DISPLAY_WIDTH - 1)
+		xEnd = DISPLAY_WIDTH - 1;
+	if(yEnd > DISPLAY_HEIGHT - 1)
+		yEnd = DISPLAY_HEIGHT - 1;
+	if(xBeg > xEnd || yBeg > yEnd)
+		return;
+	if(m_FrameInterval)
+	{
+		mark_dirty(xBeg, yBeg, xEnd, yEnd);                                          // Paced frame sends the region with the rest
+		defer_update(false);
+		return;
+	}
+	
+	set_pos(xBeg, yBeg >> 3, xEnd, yEnd >> 3);
+	for(uint8_t page = yBeg >> 3; page <= (yEnd >> 3); ++page)                     // Address pointer goes on between transactions
+	{
+		i2c_WriteData(m_Buffer + page * DISPLAY_WIDTH + xBeg, xEnd - xBeg + 1);
+		if(m_DirtyBeg[page] >= xBeg && m_DirtyEnd[page] <= xEnd)
+		{
+			m_DirtyBeg[page] = DISPLAY_WIDTH;
+			m_DirtyEnd[page] = 0;
+		}
+		else if(m_DirtyBeg[page] >= xBeg && m_DirtyBeg[page] <= xEnd)
+			m_DirtyBeg[page] = xEnd + 1;
+		else if(m_DirtyEnd[page] >= xBeg && m_DirtyEnd[page] <= xEnd)
+			m_DirtyEnd[page] = xBeg - 1;
+	}
+	++m_Stats.m_Updates;
+#endif
+}
+
+// Forces the next update_dirty() to transmit the whole frame
+void SSD1306_oled::invalidate()
+{
+	memset(m_DirtyBeg, 0, PAGES_COUNT);
+	memset(m_DirtyEnd, DISPLAY_WIDTH - 1, PAGES_COUNT);
+}
+
+// Copies m_Buffer to the front buffer (if SSD1306_DOUBLE_BUFFER is on) and starts the non-blocking transfer of the whole frame.
+// Drawing into m_Buffer may go on right after the return. Returns false if the previous transfer
+// is still running or nothing was started
+bool SSD1306_oled::update_screen_async(void (*pCallback)(SSD1306_oled &Obj))
+{
+	return start_async(true, pCallback);
+}
+
+bool SSD1306_oled::update_dirty_async(void (*pCallback)(SSD1306_oled &Obj))
+{
+	return start_async(false, pCallback);
+}
+
+void SSD1306_oled::set_async_transfer(ASYNC_TRANSFER mode)
+{
+	wait();
+	m_TxMode = mode;
+}
+
+bool SSD1306_oled::is_busy() const
+{
+	return m_TxBusy;
+}
+
+bool SSD1306_oled::wait(uint32_t timeout)
+{
+	uint32_t start = HAL_GetTick(), now = start;
+	while(m_TxBusy && (now = HAL_GetTick()) - start < timeout)
+		;
+	m_Stats.m_BlockedTicks += now - start;
+	
+	return !m_TxBusy;
+}
+
+// Must be called from HAL_I2C_MemTxCpltCallback() or HAL_SPI_TxCpltCallback() with the HAL handle
+void SSD1306_oled::transfer_complete(const void *pHandle)
+{
+	if(pHandle != m_pTransport->handle() || !m_TxBusy)
+		return;
+	
+	m_pTransport->complete();
+	if(tx_next())
+		return;
+	
+	m_TxBusy = false;
+	if(m_pTxCallback)
+		m_pTxCallback(*this);
+}
+
+// Must be called from HAL_I2C_ErrorCallback() or HAL_SPI_ErrorCallback(). The interrupted frame is sent again with the next update
+void SSD1306_oled::transfer_error(const void *pHandle)
+{
+	if(pHandle != m_pTransport->handle() || !m_TxBusy)
+		return;
+	
+	m_pTransport->complete();
+	invalidate();
+	m_TxBusy = false;
+}
+
+// Paced mode: update_screen(), update_dirty() and update_region() only mark the frame pending and service() sends it,
+// not more often than max_fps times per second, so the updates of one logical frame go as one transfer. Asynchronous paced
+// frames go by update_dirty_async(). max_fps 0 turns the mode off and sends the pending frame
+void SSD1306_oled::set_frame_rate(uint8_t max_fps, bool bAsync)
+{
+	bool bFlush = m_FramePending && !max_fps;
+	
+	m_FrameInterval = max_fps ? (1000 + max_fps - 1) / max_fps : 0;              // Rounded up, so the rate isn't exceeded
+	m_PacedAsync = bAsync;
+	m_LastFrame = HAL_GetTick() - m_FrameInterval;
+	if(bFlush)
+	{
+		m_FramePending = false;
+		send_dirty();
+	}
+}
+
+// Sends the pending frame of the paced mode if the frame interval is over. Call it from the main loop or a timer tick.
+// Returns true if the frame was sent or its asynchronous transfer started
+bool SSD1306_oled::service()
+{
+	if(!m_FramePending || !m_InitState || m_HwScroll)
+		return false;
+	
+	uint32_t tick = HAL_GetTick();
+	if(tick - m_LastFrame < m_FrameInterval)
+		return false;
+#if !SSD1306_TILED
+	if(m_PacedAsync)
+	{
+		uint8_t page = 0, lastPage;
+		if(m_TxBusy)
+			return false;                                                              // Frame stays pending and takes the later updates in
+		if(next_window(m_DirtyBeg, m_DirtyEnd, page, lastPage))
+		{
+			if(!start_async(false, 0))
+				return false;                                                            // Transfer failed to start, the next service() sends the frame again
+		}
+		else if(HAL_BUSY == i2c_FlushCommands())                                       // Start line or scroll change may be left without any window
+			return false;
+	}
+	else
+#endif
+		send_dirty();
+	
+	m_FramePending = false;
+	m_LastFrame = tick;
+	++m_Stats.m_FramesSent;
+	return true;
+}
+
+// Paced mode takes the update request in. Returns false if the update must be sent at once
+bool SSD1306_oled::defer_update(bool bFullFrame)
+{
+	if(!m_FrameInterval)
+		return false;
+	
+	if(bFullFrame)
+		invalidate();
+	if(m_FramePending)
+		++m_Stats.m_FramesCoalesced;
+	m_FramePending = true;
+	return true;
+}
+
+const SSD1306_oled::BusStats &SSD1306_oled::bus_stats() const
+{
+	return m_Stats;
+}
+
+void SSD1306_oled::reset_bus_stats()
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+// Average data of one update call in thousandths of the whole frame: 1000 if every update sends the full frame,
+// less if dirty tracking works. Bus cost of a frame is m_DataBytes + m_CommandBytes and m_Transactions per m_Updates
+uint16_t SSD1306_oled::frames_per_update() const
+{
+	if(!m_Stats.m_Updates)
+		return 0;
+	
+	uint32_t perMille = m_Stats.m_DataBytes / m_Stats.m_Updates * 1000 / (DISPLAY_WIDTH * PAGES_COUNT);
+	return perMille > 0xFFFF ? 0xFFFF : perMille;
+}
+
+// In the paced mode only the buffer is cleared, the next requested frame sends it
+void SSD1306_oled::clear_screen()
+{
+	clear_buffer();
+	if(!m_FrameInterval)
+		send_screen();
+}
+
+void SSD1306_oled::clear_buffer()
+{
+	memset(m_Buffer, 0, BUFFER_SIZE);
+	invalidate();
+#if SSD1306_TILED
+	m_ListSize = 0;
+	m_LastText = NO_TEXT_RECORD;
+	m_ListFontsCount = 0;
+	m_ListPageFontsCount = 0;
+	m_ListOverflow = false;
+#endif
+}
+
+void SSD1306_oled::set_pos(uint8_t pos_x_beg, uint8_t pos_y_beg, uint8_t pos_x_end, uint8_t pos_y_end)
+{
+	if(pos_x_beg > DISPLAY_WIDTH - 1)
+		pos_x_beg = DISPLAY_WIDTH - 1;
+	if(pos_x_end > DISPLAY_WIDTH - 1)
+		pos_x_end = DISPLAY_WIDTH - 1;
+	
+	if(pos_y_beg > PAGES_COUNT - 1)
+		pos_y_beg = PAGES_COUNT - 1;
+	if(pos_y_end > PAGES_COUNT - 1)
+		pos_y_end = PAGES_COUNT - 1;	
+		
+	i2c_WriteCommand(SET_COLUMN_ADDRESS);
+	i2c_WriteCommand(pos_x_beg + COLUMN_OFFSET);                                   // |
+	i2c_WriteCommand(pos_x_end + COLUMN_OFFSET);                                   // | Columns 0...127
+	i2c_WriteCommand(SET_PAGE_ADDRESS);
+	i2c_WriteCommand(pos_y_beg);                                                   // |
+	i2c_WriteCommand(pos_y_end);                                                   // | Pages 0...7
+	i2c_FlushCommands();
+}
+
+void SSD1306_oled::set_cursor(int16_t x, int16_t y)
+{
+	m_CurX = x;
+	m_CurY = y;
+}
+
+// Limits all drawing to the rectangle (and the screen)
+void SSD1306_oled::set_clip(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+	int32_t xEnd = (int32_t)x + width - 1, yEnd = (int32_t)y + height - 1;
+	
+	m_ClipX0 = x < 0 ? 0 : x;
+	m_ClipY0 = y < 0 ? 0 : y;
+	m_ClipX1 = xEnd > DISPLAY_WIDTH - 1 ? DISPLAY_WIDTH - 1 : xEnd;
+	m_ClipY1 = yEnd > DISPLAY_HEIGHT - 1 ? DISPLAY_HEIGHT - 1 : yEnd;
+	record(_CMD_CLIP, m_ClipX0, m_ClipY0, m_ClipX1, m_ClipY1);
+}
+
+void SSD1306_oled::reset_clip()
+{
+	set_clip(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+// Starts continuous scroll of pages page_beg...page_end by the controller. The frame is sent first, then updates
+// do nothing until stop_scroll(), because GDDRAM must not be changed while the scroll runs. For _SCROLL_UP_RIGHT
+// and _SCROLL_UP_LEFT the content also goes up by vert_offset rows every step inside the vertical scroll area,
+// which is fixed_rows top rows that don't move and then area_rows rows that do
+void SSD1306_oled::start_scroll(SCROLL_DIRECTION direction, uint8_t page_beg, uint8_t page_end, SCROLL_INTERVAL interval,
+                                uint8_t vert_offset, uint8_t fixed_rows, uint8_t area_rows)
+{
+	if(!m_InitState)
+		return;
+	if(m_HwScroll)
+		stop_scroll();
+	send_dirty();
+	
+	if(page_end > PAGES_COUNT - 1)
+		page_end = PAGES_COUNT - 1;
+	if(page_beg > page_end)
+		page_beg = page_end;
+	
+	i2c_WriteCommand(DEACTIVATE_SCROLL);                   // Setup is valid only while scroll is off
+	if(_SCROLL_RIGHT == direction || _SCROLL_LEFT == direction)
+	{
+		i2c_WriteCommand(_SCROLL_RIGHT == direction ? RIGHT_HORIS_SCROLL : LEFT_HORIS_SCROLL);
+		i2c_WriteCommand(0x00);
+		i2c_WriteCommand(page_beg);
+		i2c_WriteCommand(interval);
+		i2c_WriteCommand(page_end);
+		i2c_WriteCommand(0x00);
+		i2c_WriteCommand(0xFF);
+	}
+	else
+	{
+		if(fixed_rows + area_rows > DISPLAY_HEIGHT)
+			area_rows = DISPLAY_HEIGHT - fixed_rows;
+		i2c_WriteCommand(SET_VERT_SCROLL_AREA);
+		i2c_WriteCommand(fixed_rows);
+		i2c_WriteCommand(area_rows);
+		i2c_WriteCommand(_SCROLL_UP_RIGHT == direction ? VERT_RIGHT_HORIS_SCROLL : VERT_LEFT_HORIS_SCROLL);
+		i2c_WriteCommand(0x00);
+		i2c_WriteCommand(page_beg);
+		i2c_WriteCommand(interval);
+		i2c_WriteCommand(page_end);
+		i2c_WriteCommand(vert_offset & (RAM_ROWS - 1));
+	}
+	i2c_WriteCommand(ACTIVATE_SCROLL);
+	i2c_FlushCommands();
+	m_HwScroll = true;
+}
+
+// Stops continuous scroll. The controller view is lost, so the next update_dirty() sends the whole frame
+void SSD1306_oled::stop_scroll()
+{
+	if(!m_HwScroll)
+		return;
+	
+	i2c_WriteCommand(DEACTIVATE_SCROLL);
+	i2c_WriteCommand(SET_START_LINE | m_StartLine);
+	i2c_FlushCommands();
+	m_HwScroll = false;
+	invalidate();
+}
+
+bool SSD1306_oled::is_scrolling() const
+{
+	return m_HwScroll;
+}
+
+#if SSD1306_HEIGHT == 64
+// Sets the buffer row which is shown at the top of the screen, the rows below it go round the buffer.
+// Drawing coordinates stay buffer ones, view_row() gives the buffer row of a screen row. The command goes
+// with the next update, right before the frame data
+void SSD1306_oled::set_start_line(uint8_t line)
+{
+	m_StartLine = line & (RAM_ROWS - 1);
+	if(m_InitState && !m_HwScroll)
+		i2c_WriteCommand(SET_START_LINE | m_StartLine);
+}
+
+uint8_t SSD1306_oled::get_start_line() const
+{
+	return m_StartLine;
+}
+
+// Scrolls the screen content up (rows > 0) or down (rows < 0) by moving the start line. Only the rows which come
+// into view are cleared and sent with the next update_dirty(), the rest of the screen isn't transmitted again
+void SSD1306_oled::scroll_rows(int8_t rows)
+{
+	uint8_t count = rows < 0 ? -rows : rows;
+	if(!count)
+		return;
+	
+	uint8_t line = m_StartLine;
+	set_start_line(m_StartLine + rows);
+	clear_rows(rows > 0 ? line : m_StartLine, count);
+}
+
+// Buffer row shown at the screen row y
+int16_t SSD1306_oled::view_row(int16_t y) const
+{
+	return (y + m_StartLine) & (RAM_ROWS - 1);
+}
+#endif
+
+// Clears count buffer rows beginning from row and going round the buffer, whatever the clip rectangle is
+void SSD1306_oled::clear_rows(uint8_t row, uint8_t count)
+{
+	int16_t clipX0 = m_ClipX0, clipY0 = m_ClipY0, clipX1 = m_ClipX1, clipY1 = m_ClipY1;
+	
+	if(count > DISPLAY_HEIGHT)
+		count = DISPLAY_HEIGHT;
+	reset_clip();
+	draw_fill_rectangle(0, row, DISPLAY_WIDTH, count, _DRAW_CLEAR);
+	if(row + count > DISPLAY_HEIGHT)
+		draw_fill_rectangle(0, 0, DISPLAY_WIDTH, row + count - DISPLAY_HEIGHT, _DRAW_CLEAR);
+	set_clip(clipX0, clipY0, clipX1 - clipX0 + 1, clipY1 - clipY0 + 1);
+}
+
+void SSD1306_oled::draw_pixel(int16_t x, int16_t y)
+{
+	if(record(_CMD_PIXEL, x, y))
+		return;
+	
+	if(x < m_ClipX0 || x > m_ClipX1 || y < m_ClipY0 || y > m_ClipY1)
+		return;
+	put_pixel(x, y, true);
+	mark_dirty(x, y, x, y);
+}
+
+void SSD1306_oled::draw_pixel_inverted(int16_t x, int16_t y)
+{
+	if(record(_CMD_PIXEL_INVERTED, x, y))
+		return;
+	
+	if(x < m_ClipX0 || x > m_ClipX1 || y < m_ClipY0 || y > m_ClipY1)
+		return;
+	put_pixel(x, y, false);
+	mark_dirty(x, y, x, y);
+}
+
+void SSD1306_oled::draw_horisontal_line(int16_t x, int16_t y, uint16_t length, uint16_t thickness)
+{
+	if(record(_CMD_HORISONTAL_LINE, x, y, length, thickness))
+		return;
+	
+	fill_span(x, y, length, thickness, _DRAW_OR);
+}
+
+void SSD1306_oled::draw_vertical_line(int16_t x, int16_t y, uint16_t length, uint16_t thickness)
+{
+	if(record(_CMD_VERTICAL_LINE, x, y, length, thickness))
+		return;
+	
+	fill_span(x, y, thickness, length, _DRAW_OR);
+}
+
+// Only the visible part of the line is stepped, see clip_line()
+void SSD1306_oled::draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	if(record(_CMD_LINE, x0, y0, x1, y1))
+		return;
+	
+	LineStepper line;
+	if(!clip_line(x0, y0, x1, y1, m_ClipX0, m_ClipY0, m_ClipX1, m_ClipY1, line))
+		return;
+	
+	int16_t minorBeg = line.m_Minor, minorEnd = line.m_Minor;
+	int16_t majorBeg = line.m_Major;
+	for( ; line.m_Major <= line.m_MajorEnd; ++line.m_Major)
+	{
+		minorEnd = line.m_Minor;                              // Last plotted, the step after the last pixel isn't drawn
+		if(line.m_Steep)
+			put_pixel(line.m_Minor, line.m_Major, true);
+		else
+			put_pixel(line.m_Major, line.m_Minor, true);
+		
+		line.m_Err -= line.m_Dy;
+		if(line.m_Err < 0)
+		{
+			line.m_Minor += line.m_MinorStep;
+			line.m_Err += line.m_Dx;
+		}
+	}
+	
+	int16_t minorMin = minorBeg < minorEnd ? minorBeg : minorEnd, minorMax = minorBeg < minorEnd ? minorEnd : minorBeg;
+	if(line.m_Steep)
+		mark_dirty(minorMin, majorBeg, minorMax, line.m_MajorEnd);
+	else
+		mark_dirty(majorBeg, minorMin, line.m_MajorEnd, minorMax);
+}
+
+void SSD1306_oled::draw_rectangle(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t thickness)
+{
+	if(record(_CMD_RECTANGLE, x, y, width, height, thickness))
+		return;
+	
+	draw_horisontal_line(x, y, width, thickness);
+	draw_horisontal_line(x, y + height, width, thickness);
+	draw_vertical_line(x, y, height, thickness);
+	draw_vertical_line(x + width, y, height + thickness, thickness);
+}
+
+void SSD1306_oled::draw_fill_rectangle(int16_t x, int16_t y, uint16_t width, uint16_t height, DRAW_MODE mode)
+{
+	if(record(_CMD_FILL_RECTANGLE, x, y, width, height, mode))
+		return;
+	
+	fill_span(x, y, width, height, mode);
+}
+
+void SSD1306_oled::draw_triangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3)
+{
+	if(record(_CMD_TRIANGLE, x1, y1, x2, y2, x3, y3))
+		return;
+	
+	draw_line(x1, y1, x2, y2);
+	draw_line(x2, y2, x3, y3);
+	draw_line(x3, y3, x1, y1);
+}
+
+// Fills every row between the leftmost and the rightmost pixel of the triangle outline, so the result
+// covers draw_triangle() exactly
+void SSD1306_oled::draw_fill_triangle(int16_t x1, int16_t y1, int16_t x2, int16_t y2, int16_t x3, int16_t y3, DRAW_MODE mode)
+{
+	if(record(_CMD_FILL_TRIANGLE, x1, y1, x2, y2, x3, y3, mode))
+		return;
+	
+	int16_t points[] = {x1, y1, x2, y2, x3, y3};
+	draw_fill_polygon(points, 3, mode);
+}
+
+// Points are x0, y0, x1, y1... The outline is closed from the last point to the first one
+void SSD1306_oled::draw_polygon(const int16_t *pPoints, uint8_t count)
+{
+	if(record_polygon(pPoints, count, 0xFF))
+		return;
+	
+	for(uint8_t i = 0; i < count; ++i)
+	{
+		uint8_t next = (i + 1) % count;
+		draw_line(pPoints[2 * i], pPoints[2 * i + 1], pPoints[2 * next], pPoints[2 * next + 1]);
+	}
+}
+
+// Fills a convex polygon: every row between the leftmost and the rightmost pixel of the draw_polygon() outline.
+// Concave polygons get their concavities along rows filled too
+void SSD1306_oled::draw_fill_polygon(const int16_t *pPoints, uint8_t count, DRAW_MODE mode)
+{
+	if(!count || record_polygon(pPoints, count, mode))
+		return;
+	
+	int32_t xBeg = pPoints[0], yBeg = pPoints[1], xEnd = pPoints[0], yEnd = pPoints[1];
+	for(uint8_t i = 1; i < count; ++i)
+	{
+		if(pPoints[2 * i] < xBeg)
+			xBeg = pPoints[2 * i];
+		if(pPoints[2 * i] > xEnd)
+			xEnd = pPoints[2 * i];
+		if(pPoints[2 * i + 1] < yBeg)
+			yBeg = pPoints[2 * i + 1];
+		if(pPoints[2 * i + 1] > yEnd)
+			yEnd = pPoints[2 * i + 1];
+	}
+	if(!clip_box(xBeg, yBeg, xEnd, yEnd))
+		return;
+	
+	int16_t rowMin[DISPLAY_HEIGHT], rowMax[DISPLAY_HEIGHT];
+	for(uint8_t i = 0; i < DISPLAY_HEIGHT; ++i)
+	{
+		rowMin[i] = INT16_MAX;
+		rowMax[i] = INT16_MIN;
+	}
+	
+	for(uint8_t i = 0; i < count; ++i)
+	{
+		uint8_t next = (i + 1) % count;
+		line_spans(pPoints[2 * i], pPoints[2 * i + 1], pPoints[2 * next], pPoints[2 * next + 1], rowMin, rowMax);
+	}
+	fill_rows(rowMin, rowMax, mode);
+}
+
+void SSD1306_oled::draw_circle(int16_t x0, int16_t y0, uint16_t radius)
+{
+	if(record(_CMD_CIRCLE, x0, y0, radius))
+		return;
+	
+	int32_t xBeg = x0 - radius, yBeg = y0 - radius, xEnd = x0 + radius, yEnd = y0 + radius;
+	if(!clip_box(xBeg, yBeg, xEnd, yEnd))
+		return;
+	mark_dirty(xBeg, yBeg, xEnd, yEnd);
+	if(!radius)                                             // The loop would step to the diagonal neighbours
+	{
+		plot(x0, y0);
+		return;
+	}
+	
+	int32_t x = 0, y = radius;
+	int32_t dp = 1 - radius;
+	do
+	{
+		if(dp < 0)
+			dp = dp + 2 * (++x) + 3;
+		else
+			dp = dp + 2 * (++x) - 2 * (--y) + 5;
+
+		plot(x0 + x, y0 + y);     // For the 8 octants
+		plot(x0 - x, y0 + y);
+		plot(x0 + x, y0 - y);
+		plot(x0 - x, y0 - y);
+		plot(x0 + y, y0 + x);
+		plot(x0 - y, y0 + x);
+		plot(x0 + y, y0 - x);
+		plot(x0 - y, y0 - x);
+
+	}while (x < y);
+
+	plot(x0 + radius, y0);
+	plot(x0, y0 + radius);
+	plot(x0 - radius, y0);
+	plot(x0, y0 - radius);
+}
+
+// Takes the vertical half-extent of every column from the outline points of draw_circle() and fills the disc
+// column by column, so each pixel is drawn once and each buffer byte is written once. Only the columns inside
+// the clip rectangle are kept
+void SSD1306_oled::draw_fill_circle(int16_t x0, int16_t y0, uint16_t radius, DRAW_MODE mode)
+{
+	if(record(_CMD_FILL_CIRCLE, x0, y0, radius, mode))
+		return;
+	
+	if(radius > INT16_MAX)
+		radius = INT16_MAX;
+	int32_t xBeg = x0 - radius, yBeg = y0 - radius, xEnd = x0 + radius, yEnd = y0 + radius;
+	if(!clip_box(xBeg, yBeg, xEnd, yEnd))
+		return;
+	
+	// Visible column offsets from the center are dxLo...dxHi, there are not more of them than the screen width
+	int32_t dxLo = x0 < xBeg ? xBeg - x0 : (x0 > xEnd ? x0 - xEnd : 0);
+	int32_t dxHi = xEnd - x0 > x0 - xBeg ? xEnd - x0 : x0 - xBeg;
+	int16_t extent[DISPLAY_WIDTH];
+	for(int32_t i = 0; i <= dxHi - dxLo; ++i)
+		extent[i] = -1;
+	
+#define SET_EXTENT(dx, h) if((dx) >= dxLo && (dx) <= dxHi && extent[(dx) - dxLo] < (h)) extent[(dx) - dxLo] = (h);
+	SET_EXTENT(0, (int16_t)radius);
+	SET_EXTENT((int32_t)radius, 0);
+	
+	int32_t x = 0, y = radius;
+	int32_t dp = 1 - radius;
+	do
+	{
+		if(dp < 0)
+			dp = dp + 2 * (++x) + 3;
+		else
+			dp = dp + 2 * (++x) - 2 * (--y) + 5;
+		
+		SET_EXTENT(x, y);
+		SET_EXTENT(y, x);
+	} while (x < y);
+#undef SET_EXTENT
+	
+	for(int32_t dx = dxLo; dx <= dxHi; ++dx)
+	{
+		int16_t e = extent[dx - dxLo];
+		if(e < 0)
+			continue;
+		if(x0 + dx <= xEnd)
+			fill_span(x0 + dx, y0 - e, 1, 2 * e + 1, mode);
+		if(dx && x0 - dx >= xBeg)
+			fill_span(x0 - dx, y0 - e, 1, 2 * e + 1, mode);
+	}
+}
+
+// Draws the 1bpp image, which is (height + 7) / 8 pages of width column bytes like GDDRAM (bit 0 is the top row
+// of a page), at any x and y. Image pixels are combined with the buffer by op. For sprites pMask has the same layout,
+// pixels under its zero bits are left as they are
+void SSD1306_oled::draw_bitmap(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, RASTER_OP op,
+                               const uint8_t *pMask)
+{
+	if(record_bitmap(x, y, width, height, pImage, op, pMask))
+		return;
+	
+	blit(x, y, width, height, pImage, width, 0, pMask, op);
+}
+
+#if !SSD1306_TILED
+// Copies the buffer region to x, y, e.g. for sliding menus. Regions may overlap. Part of the region out of
+// the screen is not copied, the destination is clipped by the clip rectangle
+void SSD1306_oled::copy_region(int16_t src_x, int16_t src_y, uint16_t width, uint16_t height, int16_t x, int16_t y)
+{
+	int32_t xBeg = src_x, yBeg = src_y, xEnd = src_x + width - 1, yEnd = src_y + height - 1;
+	
+	if(xBeg < 0)
+		xBeg = 0;
+	if(yBeg < 0)
+		yBeg = 0;
+	if(xEnd > DISPLAY_WIDTH - 1)
+		xEnd = DISPLAY_WIDTH - 1;
+	if(yEnd > DISPLAY_HEIGHT - 1)
+		yEnd = DISPLAY_HEIGHT - 1;
+	if(xBeg > xEnd || yBeg > yEnd)
+		return;
+	
+	blit(x + xBeg - src_x, y + yBeg - src_y, xEnd - xBeg + 1, yEnd - yBeg + 1, m_Buffer + (yBeg >> 3) * DISPLAY_WIDTH + xBeg,
+	     DISPLAY_WIDTH, yBeg & 7, 0, _ROP_COPY);
+}
+
+// Decodes one frame of the compressed animation stream made by tools/ssd1306_animenc.cpp into the buffer and returns
+// the next frame, or 0 at the end of the stream. Frame is the flags byte and the runs covering the whole buffer:
+// control byte FRAME_RUN_REPEAT | (n - 1) is followed by one byte repeated n times, control byte n - 1 by n literal bytes.
+// Key frame bytes replace the buffer ones, delta frame bytes are XORed with them. Only the bytes which really change
+// are marked dirty, so update_dirty() transmits just the difference. The clip rectangle isn't applied
+const uint8_t *SSD1306_oled::draw_frame(const uint8_t *pFrame)
+{
+	if(FRAME_END == *pFrame)
+		return 0;
+	
+	bool bDelta = *pFrame++ & FRAME_DELTA;
+	for(uint16_t offset = 0; offset < BUFFER_SIZE; )
+	{
+		uint8_t control = *pFrame++;
+		uint8_t count = (control & ~FRAME_RUN_REPEAT) + 1;
+		bool bRepeat = control & FRAME_RUN_REPEAT;
+		
+		if(bRepeat && bDelta && !*pFrame)                    // Unchanged bytes are only skipped
+		{
+			offset += count;
+			++pFrame;
+			continue;
+		}
+		for( ; count; --count, ++offset)
+		{
+			uint8_t value = bRepeat ? *pFrame : *pFrame++;
+			if(offset >= BUFFER_SIZE)                          // Broken stream, the run is only passed
+				continue;
+			if(bDelta)
+				value ^= m_Buffer[offset];
+			if(value != m_Buffer[offset])
+			{
+				m_Buffer[offset] = value;
+				mark_dirty_byte(offset);
+			}
+		}
+		if(bRepeat)
+			++pFrame;
+	}
+	
+	return pFrame;
+}
+
+// Sends the buffer columns within the pages using vertical addressing, so the page bytes of a column go one
+// after another. Horizontal addressing is restored before returning, so the next set_pos() isn't sent in vertical mode
+void SSD1306_oled::send_columns(uint8_t x_beg, uint8_t x_end, uint8_t page_beg, uint8_t page_end)
+{
+	uint8_t data[2 * PAGES_COUNT];
+	uint8_t size = 0;
+	
+	i2c_WriteCommand(SET_MEM_ADDRESS_MODE);
+	i2c_WriteCommand(_VERT_ADDRESS_MODE);
+	set_pos(x_beg, page_beg, x_end, page_end);
+	for(uint8_t x = x_beg; x <= x_end; ++x)
+	{
+		for(uint8_t page = page_beg; page <= page_end; ++page)
+			data[size++] = m_Buffer[page * DISPLAY_WIDTH + x];
+		if(x == x_end || size + page_end - page_beg + 1 > 2 * PAGES_COUNT)
+		{
+			i2c_WriteData(data, size);
+			size = 0;
+		}
+	}
+	i2c_WriteCommand(SET_MEM_ADDRESS_MODE);
+	i2c_WriteCommand(_HORIS_ADDRESS_MODE);
+	i2c_FlushCommands();
+}
+
+// Sets up the strip chart of width columns at x. Its rows y...y + height - 1 are widened to whole pages, so
+// the chart shouldn't share pages with other drawing. The chart area is cleared and marked dirty.
+// The clip rectangle isn't applied
+void SSD1306_oled::init_chart(StripChart &Chart, uint8_t x, uint8_t y, uint8_t width, uint8_t height, int16_t min, int16_t max)
+{
+	if(x > DISPLAY_WIDTH - 2)
+		x = DISPLAY_WIDTH - 2;
+	if(width > DISPLAY_WIDTH - x)
+		width = DISPLAY_WIDTH - x;
+	if(width < 2)                                          // Sample column and the erased one
+		width = 2;
+	if(y > DISPLAY_HEIGHT - 1)
+		y = DISPLAY_HEIGHT - 1;
+	if(!height)
+		height = 1;
+	if(height > DISPLAY_HEIGHT - y)
+		height = DISPLAY_HEIGHT - y;
+	if(max <= min)                                         // Empty range gets one step, INT16_MAX can't be exceeded
+	{
+		if(INT16_MAX == min)
+			--min;
+		max = min + 1;
 	}
+	
+	Chart.m_X = x;
+	Chart.m_Width = width;
+	Chart.m_PageBeg = y >> 3;
+	Chart.m_PageEnd = (y + height - 1) >> 3;
+	Chart.m_Min = min;
+	Chart.m_Max = max;
+	Chart.m_Column = 0;
+	Chart.m_Row = -1;
+	
+	for(uint8_t page = Chart.m_PageBeg; page <= Chart.m_PageEnd; ++page)
+		memset(m_Buffer + page * DISPLAY_WIDTH + x, 0, width);
+	mark_dirty(x, Chart.m_PageBeg * 8, x + width - 1, Chart.m_PageEnd * 8 + 7);
+}
 
-	void SSD1306_oled::i2c_WriteCommand(uint8_t nCommand)
+// Draws the sample into the ring column as the vertical segment from the previous sample, erases the next column
+// and transmits both of them, which is 2 bytes per chart page instead of the whole frame.
+// While the controller scrolls by itself the columns are only marked dirty, in paced mode they go with the next frame
+void SSD1306_oled::chart_sample(StripChart &Chart, int16_t value)
+{
+	if(value < Chart.m_Min)
+		value = Chart.m_Min;
+	if(value > Chart.m_Max)
+		value = Chart.m_Max;
+	
+	int16_t bottom = Chart.m_PageEnd * 8 + 7, rows = (Chart.m_PageEnd - Chart.m_PageBeg + 1) * 8;
+	int16_t row = bottom - (int32_t)(value - Chart.m_Min) * (rows - 1) / (Chart.m_Max - Chart.m_Min);
+	int16_t rowBeg = Chart.m_Row < 0 || Chart.m_Row > row ? row : Chart.m_Row;
+	int16_t rowEnd = Chart.m_Row > row ? Chart.m_Row : row;
+	uint8_t x = Chart.m_X + Chart.m_Column;
+	uint8_t next = Chart.m_Column + 1 < Chart.m_Width ? x + 1 : Chart.m_X;
+	
+	for(uint8_t page = Chart.m_PageBeg; page <= Chart.m_PageEnd; ++page)
 	{
-		HAL_I2C_Mem_Write(m_I2C_Port, m_SSD1306_I2C_Address, COMMAND_TO_SEND, sizeof(uint8_t), &nCommand, 1, COMMAND_SEND_TIMEOUT);
+		int16_t top = page * 8, beg = rowBeg > top ? rowBeg : top, end = rowEnd < top + 7 ? rowEnd : top + 7;
+		m_Buffer[page * DISPLAY_WIDTH + x] = beg <= end ? (0xFF << (beg & 7)) & (0xFF >> (7 - (end & 7))) : 0;
+		m_Buffer[page * DISPLAY_WIDTH + next] = 0;
 	}
+	Chart.m_Column = next - Chart.m_X;
+	Chart.m_Row = row;
 	
-	void SSD1306_oled::i2c_WriteData(uint8_t *pData, uint16_t nSize)
+	if(!m_InitState || m_HwScroll || m_FrameInterval)
 	{
-		HAL_I2C_Mem_Write(m_I2C_Port, m_SSD1306_I2C_Address, DATA_TO_SEND, sizeof(uint8_t), pData, nSize, 10 * COMMAND_SEND_TIMEOUT);
+		mark_dirty(x, Chart.m_PageBeg * 8, x, bottom);
+		mark_dirty(next, Chart.m_PageBeg * 8, next, bottom);
+		defer_update(false);                                  // Paced mode sends the columns with the next frame
+		return;
 	}
 	
-	void SSD1306_oled::reset_oled()
+	if(next == x + 1)
+		send_columns(x, next, Chart.m_PageBeg, Chart.m_PageEnd);
+	else
 	{
-		HAL_Delay(100);
-		HAL_GPIO_WritePin(m_GPIO_Port, m_GPIO_Pin, GPIO_PIN_RESET);
-		HAL_Delay(10);
-		HAL_GPIO_WritePin(m_GPIO_Port, m_GPIO_Pin, GPIO_PIN_SET);
-		HAL_Delay(10);
+		send_columns(x, x, Chart.m_PageBeg, Chart.m_PageEnd);
+		send_columns(next, next, Chart.m_PageBeg, Chart.m_PageEnd);
 	}
+	++m_Stats.m_Updates;
+}
+#endif
+
+// Glyph is clipped by the clip rectangle. The char is refused only if it begins beyond the right
+// or the bottom edge of the clip rectangle, so text may go partially out of the screen
+char SSD1306_oled::write_char(char ch, FontDef Font)
+{
+	uint32_t b;
+
+	if (m_CurX > m_ClipX1 || m_CurY > m_ClipY1)
+		return 0;  		                                       // Not enough space on current line
 	
-	void inline SSD1306_oled::check_limits(uint16_t &x, uint16_t &y)
+	if(!record_char(ch, Font))
 	{
-		if(x > DISPLAY_WIDTH - 1)
-			x = DISPLAY_WIDTH - 1;
+		int32_t xBeg = m_CurX, yBeg = m_CurY, xEnd = m_CurX + Font.m_Width - 1, yEnd = m_CurY + Font.m_Height - 1;
+		if(clip_box(xBeg, yBeg, xEnd, yEnd))
+		{
+			mark_dirty(xBeg, yBeg, xEnd, yEnd);
+			for (int16_t i = yBeg - m_CurY; i <= yEnd - m_CurY; i++)   // Use the font to write
+			{
+				b = Font.m_pData[(ch - 32) * Font.m_Height + i];
+				for (int16_t j = xBeg - m_CurX; j <= xEnd - m_CurX; j++)
+					put_pixel(m_CurX + j, m_CurY + i, (b << j) & 0x8000);
+			}
+		}
+	}
+	m_CurX += Font.m_Width;                                // The current space is now taken
 	
-		if(y > DISPLAY_HEIGHT - 1)
-			y = DISPLAY_HEIGHT - 1;
+	return ch;                                             // Return written char for validation
+}
+
+char SSD1306_oled::write_string(const char *str, FontDef Font)
+{	
+	while (*str)                                           // Write until null-byte
+	{
+		if (write_char(*str, Font) != *str)			
+			return *str;                                       // Char could not be written		
+		str++;                                               // Next char
 	}
 	
-uint8_t SSD1306_oled::ssd1306_Init()
+	return *str;                                           // Everything ok
+}
+
+// Same as write_char() for FontDef, but the glyph is copied by whole column bytes
+char SSD1306_oled::write_char(char ch, const PageFontDef &Font)
 {
-	HAL_Delay(500);
-	if(HAL_I2C_IsDeviceReady(m_I2C_Port, m_SSD1306_I2C_Address, 5, 1000) != HAL_OK)  // Check if OLED connected to I2C
-	{
-		m_InitState = 0;
-		return 0;                                                                      // Return false
-	}
-	HAL_Delay(100);
-	reset_oled();
-	HAL_Delay(100);
-	
-	i2c_WriteCommand(SET_MULTIPLEX_RATIO);
-	i2c_WriteCommand(0x3F);                                                          // Leave reset value, 63 + 1 = 64, for displaying all screen
-	i2c_WriteCommand(SET_DISPLAY_OFFSET);
-	i2c_WriteCommand(0x00);                                                          // Leave reset value, 0, without shifting
-	i2c_WriteCommand(0x40);                                                          // Set display start line 0
-	i2c_WriteCommand(SET_COLUMN_REFL_MAPPING);
-	i2c_WriteCommand(SET_COM_REFL_MAPPING);
-	i2c_WriteCommand(SET_COM_PIN_HW_CONF);                                           // Set COM Pins hardware configuration,
-	i2c_WriteCommand(_ALTERNATIVE_HW_PIN_CONF);                                      // leave reset value
-	i2c_WriteCommand(SET_CONTRAST_CONTROL);
-	i2c_WriteCommand(128);                                                           // Middle value of contrast
-	i2c_WriteCommand(RESUME_DISPLAY_RAM);                                            // Disable entire display on
-	i2c_WriteCommand(SET_DISPLAY_NORMAL);
-	i2c_WriteCommand(SET_DISPLAY_CLOCK);
-	i2c_WriteCommand(240);                                                           // For frequency value 15 << 4 | prescaler 0 (+1 in fact)
-	i2c_WriteCommand(CHARGE_PUMP_SETTING);
-	i2c_WriteCommand(ENABLE_CHARGE_PUMP);
-	i2c_WriteCommand(SET_MEM_ADDRESS_MODE);
-	i2c_WriteCommand(_HORIS_ADDRESS_MODE);
-	i2c_WriteCommand(SET_DISPLAY_ON);	
+	if (m_CurX > m_ClipX1 || m_CurY > m_ClipY1)
+		return 0;  		                                       // Not enough space on current line
 	
-	HAL_Delay(20);
-	clear_screen();		
-	update_screen();
-	m_InitState = 1;
+	if(!record_char(ch, Font))
+		blit(m_CurX, m_CurY, Font.m_Width, Font.m_Height, Font.m_pData + (ch - 32) * ((Font.m_Height + 7) >> 3) * Font.m_Width,
+		     Font.m_Width, 0, 0, _ROP_COPY);
+	m_CurX += Font.m_Width;                                // The current space is now taken
 	
-	return 1;                                                                        // Return OK
+	return ch;                                             // Return written char for validation
 }
 
-void SSD1306_oled::update_screen()
-{
-	set_pos(0, 0, DISPLAY_WIDTH - 1, PAGES_COUNT - 1);
-	i2c_WriteData(m_pBuffer, BUFFER_SIZE);
+char SSD1306_oled::write_string(const char *str, const PageFontDef &Font)
+{	
+	while (*str)                                           // Write until null-byte
+	{
+		if (write_char(*str, Font) != *str)			
+			return *str;                                       // Char could not be written		
+		str++;                                               // Next char
+	}
+	
+	return *str;                                           // Everything ok
 }
 
-void SSD1306_oled::clear_screen()
+void SSD1306_oled::set_font(FONT font)
 {
-	memset(m_pBuffer, 0, BUFFER_SIZE);
-	update_screen();
+	if(font < _16x26)
+		m_DefFont = font;
 }
 
-void SSD1306_oled::clear_buffer()
+// Puts the value into width chars. With decimals > 0 the value is fixed-point, e.g. 1234 with 2 decimals is "12.34".
+// Digits are found by subtracting powers of ten, so neither division nor float code is used. A value which doesn't
+// fit is shown as '#' in every char
+static void format_number(int32_t value, uint8_t decimals, uint8_t width, bool bRightAlign, char *pText)
 {
-	memset(m_pBuffer, 0, BUFFER_SIZE);
+	static const uint32_t POWERS_OF_TEN[] = {1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL, 1UL};
+	static const uint8_t POWERS_COUNT = sizeof(POWERS_OF_TEN) / sizeof(POWERS_OF_TEN[0]);
+	char text[12];                                         // Sign, 10 digits and the point
+	uint8_t len = 0;
+	uint32_t magnitude = value < 0 ? 0 - (uint32_t)value : value;
+	
+	if(value < 0)
+		text[len++] = '-';
+	for(uint8_t i = 0; i < POWERS_COUNT; ++i)
+	{
+		char digit = '0';
+		for( ; magnitude >= POWERS_OF_TEN[i]; magnitude -= POWERS_OF_TEN[i])
+			++digit;
+		if(len > (value < 0) || '0' != digit || i + decimals + 1 >= POWERS_COUNT)   // Leading zeros are skipped down to "0.0..."
+		{
+			if(decimals && POWERS_COUNT - i == decimals)
+				text[len++] = '.';
+			text[len++] = digit;
+		}
+	}
+	
+	if(len > width)
+	{
+		memset(pText, '#', width);
+		return;
+	}
+	memset(pText, ' ', width);
+	memcpy(pText + (bRightAlign ? width - len : 0), text, len);
 }
 
-void SSD1306_oled::set_pos(uint8_t pos_x_beg, uint8_t pos_y_beg, uint8_t pos_x_end, uint8_t pos_y_end)
+static const FontDef &font_def(FONT font)
 {
-	if(pos_x_beg > DISPLAY_WIDTH - 1)
-		pos_x_beg = DISPLAY_WIDTH - 1;
-	if(pos_x_end > DISPLAY_WIDTH - 1)
-		pos_x_end = DISPLAY_WIDTH - 1;
-	
-	if(pos_y_beg > PAGES_COUNT - 1)
-		pos_y_beg = PAGES_COUNT - 1;
-	if(pos_y_end > PAGES_COUNT - 1)
-		pos_y_end = PAGES_COUNT - 1;	
-		
-	i2c_WriteCommand(SET_COLUMN_ADDRESS);
-	i2c_WriteCommand(pos_x_beg);                                                   // |
-	i2c_WriteCommand(pos_x_end);                                                   // | Columns 0...127
-	i2c_WriteCommand(SET_PAGE_ADDRESS);
-	i2c_WriteCommand(pos_y_beg);                                                   // |
-	i2c_WriteCommand(pos_y_end);                                                   // | Pages 0...7
-	HAL_Delay(5);	
+	switch(font)
+	{
+		case _11x18:
+			return Font_11x18;
+		case _16x26:
+			return Font_16x26;
+		default:
+			return Font_7x10;
+	}
 }
 
-void SSD1306_oled::set_cursor(uint16_t x, uint16_t y)
+// Common part of both init_number(), the font only gives the glyph width
+void SSD1306_oled::init_field(NumberField &Field, int16_t x, int16_t y, uint8_t char_width, uint8_t width, uint8_t decimals, bool bRightAlign)
 {
-	check_limits(x, y);
-	m_CurX = x;
-	m_CurY = y;
+	Field.m_X = x;
+	Field.m_Y = y;
+	Field.m_pFont = 0;
+	Field.m_pPageFont = 0;
+	Field.m_CharWidth = char_width;
+	Field.m_Width = width < NUMBER_FIELD_SIZE ? width : NUMBER_FIELD_SIZE;
+	Field.m_Decimals = decimals < 9 ? decimals : 9;
+	Field.m_RightAlign = bRightAlign;
+	memset(Field.m_Drawn, 0, NUMBER_FIELD_SIZE);
 }
 
-void SSD1306_oled::draw_pixel(uint16_t x, uint16_t y)
+// Sets up the numeric field of width chars at x, y. The field is drawn in full by the next draw_number(),
+// so it is set up again after the screen is cleared
+void SSD1306_oled::init_number(NumberField &Field, int16_t x, int16_t y, const FontDef &Font, uint8_t width, uint8_t decimals, bool bRightAlign)
 {
-	check_limits(x, y);
-	m_pBuffer[x + (y / 8) * DISPLAY_WIDTH] |= 1 << (y % 8);
+	init_field(Field, x, y, Font.m_Width, width, decimals, bRightAlign);
+	Field.m_pFont = &Font;
 }
 
-void SSD1306_oled::draw_pixel_inverted(uint16_t x, uint16_t y)
+void SSD1306_oled::init_number(NumberField &Field, int16_t x, int16_t y, const PageFontDef &Font, uint8_t width, uint8_t decimals, bool bRightAlign)
 {
-	check_limits(x, y);
-	m_pBuffer[x + (y / 8) * DISPLAY_WIDTH] &= ~(1 << (y % 8));
+	init_field(Field, x, y, Font.m_Width, width, decimals, bRightAlign);
+	Field.m_pPageFont = &Font;
 }
 
-void SSD1306_oled::draw_horisontal_line(uint16_t x, uint16_t y, uint16_t length, uint16_t thickness)
+// Draws the value into the field. Only the chars which differ from the ones on the screen are drawn, so
+// update_dirty() transmits just them. Display list is rebuilt every frame, so in tiled mode all chars are drawn
+void SSD1306_oled::draw_number(NumberField &Field, int32_t value)
 {
-	check_limits(x, y);
-	if ( (x + length) > DISPLAY_WIDTH - 1)
-    length = (DISPLAY_WIDTH - x);
-	if ( (y + thickness) > DISPLAY_HEIGHT - 1)
-    thickness = (DISPLAY_HEIGHT - y);
+	char text[NUMBER_FIELD_SIZE];
+	int16_t curX = m_CurX, curY = m_CurY;
 	
-	uint8_t *bufferPtr;
-	uint8_t drawBit;
-	
-	for(uint16_t i = 0, tempLenght = length; i < thickness; ++i, ++y, length = tempLenght)
+	format_number(value, Field.m_Decimals, Field.m_Width, Field.m_RightAlign, text);
+	for(uint8_t i = 0; i < Field.m_Width; ++i)
 	{
-		bufferPtr = m_pBuffer;		
-		bufferPtr += (y >> 3) * DISPLAY_WIDTH;
-		bufferPtr += x;
-		drawBit = 1 << (y & 7);
-	
-		while (length--)
-			*bufferPtr++ |= drawBit;
+		if(!SSD1306_TILED && text[i] == Field.m_Drawn[i])
+			continue;
+		
+		set_cursor(Field.m_X + i * Field.m_CharWidth, Field.m_Y);
+		if(Field.m_pFont)
+			write_char(text[i], *Field.m_pFont);
+		else
+			write_char(text[i], *Field.m_pPageFont);
+		Field.m_Drawn[i] = text[i];
 	}
+	m_CurX = curX;
+	m_CurY = curY;
 }
 
-void SSD1306_oled::draw_vertical_line(uint16_t x, uint16_t y, uint16_t length, uint16_t thickness)
+#if SSD1306_CONSOLE
+// Turns the terminal-style console on or off. In the console streamed text (over()) begins at the top left corner,
+// wraps at the right edge, goes to the next line by '\n' and scrolls the screen up by one line of the default font
+// when the bottom is reached. Scrolling moves the display start line, so update_dirty() transmits only the new line
+void SSD1306_oled::set_console(bool bOn)
 {
-	check_limits(x, y);
-	if ( (y + length) > DISPLAY_HEIGHT - 1)
-    length = (DISPLAY_HEIGHT - y);
-	if ( (x + thickness) > DISPLAY_WIDTH - 1)
-    thickness = (DISPLAY_WIDTH - x);
-	
-	uint8_t *bufferPtr = m_pBuffer, *tmpBufferPtr;
-	bufferPtr += (y >> 3) * DISPLAY_WIDTH;
-  bufferPtr += x;
-	tmpBufferPtr = bufferPtr;
-	
-	uint8_t drawByte = (0xFF << (y % 8)) & 0xFF;
-	for(uint16_t i = 0; i < thickness; ++i)
-		*bufferPtr++ |= drawByte;	
-	bufferPtr = tmpBufferPtr += DISPLAY_WIDTH;
-	length -= (0xFF == drawByte ? 8 : (8 - (y % 8)));
+	m_Console = bOn;
+	if(!bOn)
+		return;
 	
-	for(drawByte = 0xFF ; length >= 8; length -= 8, bufferPtr += DISPLAY_WIDTH)
-	{
-		tmpBufferPtr = bufferPtr;
-		for(uint16_t i = 0; i < thickness; ++i)
-			*bufferPtr++ |= drawByte;	
-		bufferPtr = tmpBufferPtr;
-	}
-	if(length)
-	{
-		drawByte = 0xFF >> (8 - length);
-		for(uint16_t i = 0; i < thickness; ++i)
-			*bufferPtr++ |= drawByte;
-	}
+	clear_buffer();
+	set_start_line(0);
+	m_ConsoleY = 0;
+	m_CurX = 0;
 }
 
-void SSD1306_oled::draw_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+void SSD1306_oled::console_write(const char *str)
 {
-	check_limits(x0, y0);
-	check_limits(x1, y1);
+	const FontDef &Font = font_def(m_DefFont);
 	
-	int16_t steep = abs(y1 - y0) > abs(x1 - x0);
-	if(steep)
+	while(*str)
+		console_char(*str++, Font);
+}
+
+// Console lines are in screen rows, their buffer rows go round the buffer from the start line. A glyph which
+// crosses the end of the buffer is drawn twice: its top part at the bottom of the buffer and the rest at the top
+void SSD1306_oled::console_char(char ch, const FontDef &Font)
+{
+	if('\n' == ch)
 	{
-		SWAP_UINT16_T(x0, y0);
-		SWAP_UINT16_T(x1, y1);
+		console_new_line(Font.m_Height);
+		return;
 	}
-	if(x0 > x1)
+	if('\r' == ch)
 	{
-		SWAP_UINT16_T(x0, x1);
-		SWAP_UINT16_T(y0, y1);
+		m_CurX = 0;
+		return;
 	}
-
-	int16_t dx, dy;
-	dx = x1 - x0;
-	dy = abs(y1 - y0);
-
-	int16_t err = dx / 2;
-	int16_t yStep;
-
-	yStep = y0 < y1 ? 1 : -1;
-
-	for( ; x0 <= x1; ++x0)
+	if(ch < ' ')                                           // Other control chars have no glyphs
+		return;
+	
+	if(m_CurX + Font.m_Width > DISPLAY_WIDTH)
+		console_new_line(Font.m_Height);
+	
+	int16_t x = m_CurX;
+	m_CurY = view_row(m_ConsoleY);
+	write_char(ch, Font);
+	if(m_CurY + Font.m_Height > RAM_ROWS)
 	{
-		if(steep)
-			draw_pixel(y0, x0);
-		else
-			draw_pixel(x0, y0);
-
-		err -= dy;
-		if (err < 0)
-		{
-			y0 += yStep;
-			err += dx;
-		}
+		m_CurX = x;
+		m_CurY -= RAM_ROWS;
+		write_char(ch, Font);
 	}
 }
 
-void SSD1306_oled::draw_rectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t thickness)
+// Rows below the last line are always clear, so after scrolling by one line only the rows coming into view are cleared
+void SSD1306_oled::console_new_line(uint8_t height)
 {
-	draw_horisontal_line(x, y, width, thickness);
-	draw_horisontal_line(x, y + height, width, thickness);
-	draw_vertical_line(x, y, height, thickness);
-	draw_vertical_line(x + width, y, height + thickness, thickness);
+	m_CurX = 0;
+	if(m_ConsoleY + 2 * height <= DISPLAY_HEIGHT)
+		m_ConsoleY += height;
+	else
+		scroll_rows(height);
 }
+#endif
 
-void SSD1306_oled::draw_fill_rectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+// Returns true if some drawing of the current frame was lost because the display list is full (page-tiled rendering)
+bool SSD1306_oled::display_list_overflow() const
 {
-	draw_horisontal_line(x, y, width, height);
+#if SSD1306_TILED
+	return m_ListOverflow;
+#else
+	return false;
+#endif
 }
 
-void SSD1306_oled::draw_triangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3)
+// Contrast, inverse and display on/off go to the controller at once, the buffer isn't touched.
+// A running effect returns to the new state when it's over
+void SSD1306_oled::set_contrast(uint8_t contrast)
 {
-	draw_line(x1, y1, x2, y2);
-	draw_line(x2, y2, x3, y3);
-	draw_line(x3, y3, x1, y1);
+	m_Contrast = contrast;
+	m_Fading = false;
+	if(!m_InitState)
+		return;
+	
+	i2c_WriteCommand(SET_CONTRAST_CONTROL);
+	i2c_WriteCommand(contrast);
+	i2c_FlushCommands();
+}
+
+uint8_t SSD1306_oled::get_contrast() const
+{
+	return m_Contrast;
+}
+
+void SSD1306_oled::set_inverse(bool bInverse)
+{
+	m_Inverse = bInverse;
+	if(!m_InitState || (m_Blinking && _EFFECT_INVERT == m_BlinkEffect))
+		return;
+	
+	i2c_WriteCommand(bInverse ? SET_DISPLAY_INVERSE : SET_DISPLAY_NORMAL);
+	i2c_FlushCommands();
 }
 
-void SSD1306_oled::draw_fill_triangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3)
+void SSD1306_oled::set_display_on(bool bOn)
 {
-	check_limits(x1, y1);
-	check_limits(x2, y2);
-	check_limits(x3, y3);
+	m_DisplayOn = bOn;
+	if(!m_InitState || (m_Blinking && _EFFECT_PULSE == m_BlinkEffect))
+		return;
 	
-	int16_t dX = 0, dY = 0, x = 0, y = 0, xInc1 = 0, xInc2 = 0,	yInc1 = 0, yInc2 = 0,
-					den = 0, num = 0, numAdd = 0, numPixels = 0, curPixel = 0;
+	i2c_WriteCommand(bOn ? SET_DISPLAY_ON : SET_DISPLAY_OFF);
+	i2c_FlushCommands();
+}
 
-	dX = abs(x2 - x1);
-	dY = abs(y2 - y1);
-	x = x1;
-	y = y1;
+// Changes the contrast from the current one to contrast within duration ms, driven by effect_tick(). Every step is
+// 2 command bytes. Contrast 0 still shows the picture dimly, so a fade-out usually ends with set_display_on(false)
+void SSD1306_oled::fade(uint8_t contrast, uint16_t duration, FADE_CURVE curve)
+{
+	m_FadeFrom = m_Contrast;
+	m_FadeTo = contrast;
+	m_FadeCurve = curve;
+	m_FadeDuration = duration;
+	m_FadeBeg = HAL_GetTick();
+	m_Fading = true;
+}
 
-	xInc1 = x2 >= x1 ? 1 : -1;
-	xInc2 = x2 >= x1 ? 1 : -1;
+// Turns the effect on and off every half of period ms, count times, or until stop_effect() if count is 0.
+// Driven by effect_tick(), every step is 1 command byte
+void SSD1306_oled::blink(SCREEN_EFFECT effect, uint16_t period, uint8_t count)
+{
+	if(m_Blinking)
+		show_blink(false);
+	m_BlinkEffect = effect;
+	m_BlinkHalf = period < 2 ? 1 : period / 2;
+	m_BlinkHalves = 2 * count;
+	m_BlinkBeg = HAL_GetTick();
+	m_BlinkOn = false;
+	m_Blinking = true;
+}
 
-	yInc1 = y2 >= y1 ? 1 : -1;
-	yInc2 = y2 >= y1 ? 1 : -1;
+// Stops the blink and the fade, the screen returns to the state set by the user. The contrast stays where the fade is
+void SSD1306_oled::stop_effect()
+{
+	m_Fading = false;
+	if(!m_Blinking)
+		return;
+	
+	m_Blinking = false;
+	show_blink(false);
+	i2c_FlushCommands();
+}
 
-	if (dX >= dY)
+void SSD1306_oled::show_blink(bool bOn)
+{
+	if(!m_InitState)
+		return;
+	
+	switch(m_BlinkEffect)
 	{
-		xInc1 = 0;
-		yInc2 = 0;
-		den = dX;
-		num = dX / 2;
-		numAdd = dY;
-		numPixels = dX;
+		case _EFFECT_INVERT:
+			i2c_WriteCommand(bOn != m_Inverse ? SET_DISPLAY_INVERSE : SET_DISPLAY_NORMAL);
+		break;
+		case _EFFECT_FLASH:
+			i2c_WriteCommand(bOn ? ENTIRE_DISPLAY_ON : RESUME_DISPLAY_RAM);
+		break;
+		case _EFFECT_PULSE:
+			i2c_WriteCommand(bOn || !m_DisplayOn ? SET_DISPLAY_OFF : SET_DISPLAY_ON);
+		break;
 	}
-	else
+}
+
+// Advances the fade and the blink, call it from the main loop or a timer tick often enough for a smooth fade.
+// Only the changes are sent, so a step is at most 3 command bytes. The step is skipped while an asynchronous
+// transfer runs, so the call never blocks. Returns true while an effect is running
+bool SSD1306_oled::effect_tick()
+{
+	if(!m_Fading && !m_Blinking)
+		return false;
+	if(!m_InitState || m_TxBusy)
+		return true;
+	
+	uint32_t tick = HAL_GetTick();
+	if(m_Fading)
 	{
-		xInc2 = 0;
-		yInc1 = 0;
-		den = dY;
-		num = dY / 2;
-		numAdd = dX;
-		numPixels = dY;
+		uint32_t elapsed = tick - m_FadeBeg;
+		uint8_t contrast = m_FadeTo;
+		if(elapsed < m_FadeDuration)
+		{
+			uint32_t weight = (elapsed << 8) / m_FadeDuration;                        // 0...255
+			if(_FADE_SQUARE == m_FadeCurve)
+				weight = weight * weight >> 8;
+			contrast = m_FadeFrom + (((int32_t)m_FadeTo - m_FadeFrom) * (int32_t)weight >> 8);
+		}
+		else
+			m_Fading = false;
+		if(contrast != m_Contrast)
+		{
+			m_Contrast = contrast;
+			i2c_WriteCommand(SET_CONTRAST_CONTROL);
+			i2c_WriteCommand(contrast);
+		}
 	}
-
-	for (curPixel = 0; curPixel <= numPixels; curPixel++)
+	if(m_Blinking)
 	{
-		draw_line(x, y, x3, y3);
-
-		num += numAdd;
-		if (num >= den)
+		uint32_t half = (tick - m_BlinkBeg) / m_BlinkHalf;
+		if(m_BlinkHalves && half >= m_BlinkHalves)
 		{
-			num -= den;
-			x += xInc1;
-			y += yInc1;
+			m_Blinking = false;
+			show_blink(false);
+		}
+		else if(m_BlinkOn != !(half & 1))
+		{
+			m_BlinkOn = !m_BlinkOn;
+			show_blink(m_BlinkOn);
 		}
-		x += xInc2;
-		y += yInc2;
 	}
+	i2c_FlushCommands();
+	
+	return m_Fading || m_Blinking;
 }
 
-void SSD1306_oled::draw_circle(uint16_t x0, uint16_t y0, uint16_t radius)
+// Inverts the pixels of the rectangle in the buffer, only its area is marked dirty, so update_dirty() sends just it.
+// The clip rectangle is applied
+void SSD1306_oled::invert_region(int16_t x, int16_t y, uint16_t width, uint16_t height)
 {
-	check_limits(x0, y0);
-	
-	int16_t x = 0, y = radius;
-	int16_t dp = 1 - radius;
-	do
-	{
-		if(dp < 0)
-			dp = dp + 2 * (++x) + 3;
-		else
-			dp = dp + 2 * (++x) - 2 * (--y) + 5;
-
-		draw_pixel(x0 + x, y0 + y);     // For the 8 octants
-		draw_pixel(x0 - x, y0 + y);
-		draw_pixel(x0 + x, y0 - y);
-		draw_pixel(x0 - x, y0 - y);
-		draw_pixel(x0 + y, y0 + x);
-		draw_pixel(x0 - y, y0 + x);
-		draw_pixel(x0 + y, y0 - x);
-		draw_pixel(x0 - y, y0 - x);
+	draw_fill_rectangle(x, y, width, height, _DRAW_XOR);
+}
 
-	}while (x < y);
+#if SSD1306_TILED
+// Count of 16-bit arguments of every display list record type
+static const uint8_t DRAW_COMMAND_ARGS[] = {2, 2, 4, 4, 4, 5, 5, 6, 7, 3, 4, 4};
 
-	draw_pixel(x0 + radius, y0);
-	draw_pixel(x0, y0 + radius);
-	draw_pixel(x0 - radius, y0);
-	draw_pixel(x0, y0 - radius);
+static int16_t read_arg(const uint8_t *pData)
+{
+	return (int16_t)(pData[0] | (pData[1] << 8));
 }
 
-void SSD1306_oled::draw_fill_circle(uint16_t x0, uint16_t y0, uint16_t radius)
+// Checks if rows yBeg...yEnd cross the page
+static bool rows_on_page(int32_t yBeg, int32_t yEnd, uint8_t page)
 {
-	check_limits(x0, y0);
-	int16_t x = 0, y = radius;
-  int16_t dp = 1 - radius;
-  do
-  {
-	  if(dp < 0)
-		  dp = dp + 2 * (++x) + 3;
-	  else
-		  dp = dp + 2 * (++x) - 2 * (--y) + 5;
+	return yBeg <= page * 8 + 7 && yEnd >= page * 8;
+}
 
-    draw_horisontal_line(x0 - x, y0 - y, 2*x);
-    draw_horisontal_line(x0 - x, y0 + y, 2*x);
-    draw_horisontal_line(x0 - y, y0 - x, 2*y);
-    draw_horisontal_line(x0 - y, y0 + x, 2*y);
+// Adds the drawing call to display list while not replaying it. Returns false if the call must rasterize
+bool SSD1306_oled::record(DRAW_COMMAND cmd, uint16_t a0, uint16_t a1, uint16_t a2, uint16_t a3, uint16_t a4, uint16_t a5, uint16_t a6)
+{
+	if(m_Replaying)
+		return false;
+	
+	uint8_t nArgs = DRAW_COMMAND_ARGS[cmd];
+	if(m_ListSize + 1 + 2 * nArgs > SSD1306_DISPLAY_LIST_SIZE)
+	{
+		m_ListOverflow = true;
+		return true;
+	}
+	
+	uint16_t args[] = {a0, a1, a2, a3, a4, a5, a6};                 // Signed coordinates are kept as two's complement
+	m_List[m_ListSize++] = cmd;
+	for(uint8_t i = 0; i < nArgs; ++i)
+	{
+		m_List[m_ListSize++] = args[i] & 0xFF;
+		m_List[m_ListSize++] = args[i] >> 8;
+	}
+	m_LastText = NO_TEXT_RECORD;
+	
+	return true;
+}
 
-  } while (x < y);
+// Adds the char at the cursor to display list. Chars going one by one in the same font are joined into one text record
+bool SSD1306_oled::record_char(char ch, const FontDef &Font)
+{
+	if(m_Replaying)
+		return false;
+	
+	uint8_t font = 0;
+	while(font < m_ListFontsCount && (m_ListFonts[font].m_pData != Font.m_pData ||
+	      m_ListFonts[font].m_Width != Font.m_Width || m_ListFonts[font].m_Height != Font.m_Height))
+		++font;
+	if(font == m_ListFontsCount)
+	{
+		if(LIST_FONTS_COUNT == m_ListFontsCount)
+		{
+			m_ListOverflow = true;
+			return true;
+		}
+		m_ListFonts[m_ListFontsCount++] = Font;
+	}
 	
-  draw_horisontal_line(x0 - radius, y0, 2 * radius);
+	return record_text(_CMD_TEXT, font, Font.m_Width, ch);
 }
 
-char SSD1306_oled::write_char(char ch, FontDef Font)
+bool SSD1306_oled::record_char(char ch, const PageFontDef &Font)
 {
-	uint32_t b;
+	if(m_Replaying)
+		return false;
+	
+	uint8_t font = 0;
+	while(font < m_ListPageFontsCount && (m_ListPageFonts[font].m_pData != Font.m_pData ||
+	      m_ListPageFonts[font].m_Width != Font.m_Width || m_ListPageFonts[font].m_Height != Font.m_Height))
+		++font;
+	if(font == m_ListPageFontsCount)
+	{
+		if(LIST_FONTS_COUNT == m_ListPageFontsCount)
+		{
+			m_ListOverflow = true;
+			return true;
+		}
+		m_ListPageFonts[m_ListPageFontsCount++] = Font;
+	}
+	
+	return record_text(_CMD_PAGE_TEXT, font, Font.m_Width, ch);
+}
 
-	// Check remaining space on current line
-	if (DISPLAY_WIDTH <= (m_CurX + Font.m_Width) ||	DISPLAY_HEIGHT <= (m_CurY + Font.m_Height))
-		return 0;  		                                       // Not enough space on current line
-	                                           
-	for (uint8_t i = 0; i < Font.m_Height; i++)            // Use the font to write
+// Appends the char to the last text record if it continues it or begins a new text record
+bool SSD1306_oled::record_text(DRAW_COMMAND cmd, uint8_t font, uint8_t width, char ch)
+{
+	if(NO_TEXT_RECORD != m_LastText && m_ListSize < SSD1306_DISPLAY_LIST_SIZE)
 	{
-		b = Font.m_pData[(ch - 32) * Font.m_Height + i];
-		for (uint8_t j = 0; j < Font.m_Width; j++)
+		uint8_t *pRecord = m_List + m_LastText;
+		if(pRecord[0] == cmd && pRecord[1] == font && read_arg(pRecord + 4) == m_CurY && pRecord[6] < 0xFF &&
+		   read_arg(pRecord + 2) + pRecord[6] * width == m_CurX)
 		{
-			if ((b << j) & 0x8000)
-				draw_pixel(m_CurX + j, m_CurY + i);
-			else
-				draw_pixel_inverted(m_CurX + j, m_CurY + i);
+			++pRecord[6];
+			m_List[m_ListSize++] = ch;
+			return true;
 		}
-	}	
-	m_CurX += Font.m_Width;                                // The current space is now taken
+	}
 	
-	return ch;                                             // Return written char for validation
+	if(m_ListSize + 8 > SSD1306_DISPLAY_LIST_SIZE)
+	{
+		m_ListOverflow = true;
+		return true;
+	}
+	m_LastText = m_ListSize;
+	m_List[m_ListSize++] = cmd;
+	m_List[m_ListSize++] = font;
+	m_List[m_ListSize++] = m_CurX & 0xFF;
+	m_List[m_ListSize++] = (uint16_t)m_CurX >> 8;
+	m_List[m_ListSize++] = m_CurY & 0xFF;
+	m_List[m_ListSize++] = (uint16_t)m_CurY >> 8;
+	m_List[m_ListSize++] = 1;
+	m_List[m_ListSize++] = ch;
+	
+	return true;
 }
 
-char SSD1306_oled::write_string(const char *str, FontDef Font)
-{	
-	while (*str)                                           // Write until null-byte
+// Adds the polygon to display list. mode is the fill mode or 0xFF for the outline
+bool SSD1306_oled::record_polygon(const int16_t *pPoints, uint8_t count, uint8_t mode)
+{
+	if(m_Replaying)
+		return false;
+	
+	if(count > LIST_POLYGON_POINTS || m_ListSize + 3 + 4 * count > SSD1306_DISPLAY_LIST_SIZE)
 	{
-		if (write_char(*str, Font) != *str)			
-			return *str;                                       // Char could not be written		
-		str++;                                               // Next char
+		m_ListOverflow = true;
+		return true;
 	}
 	
-	return *str;                                           // Everything ok
+	m_List[m_ListSize++] = _CMD_POLYGON;
+	m_List[m_ListSize++] = mode;
+	m_List[m_ListSize++] = count;
+	for(uint8_t i = 0; i < 2 * count; ++i)
+	{
+		m_List[m_ListSize++] = pPoints[i] & 0xFF;
+		m_List[m_ListSize++] = (uint16_t)pPoints[i] >> 8;
+	}
+	m_LastText = NO_TEXT_RECORD;
+	
+	return true;
 }
 
-void SSD1306_oled::set_font(FONT font)
+// Adds the bitmap to display list. Only the image pointers are kept, so the images must live until update_screen()
+bool SSD1306_oled::record_bitmap(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, RASTER_OP op,
+                                 const uint8_t *pMask)
 {
-	if(font < _16x26)
-		m_DefFont = font;
+	if(m_Replaying)
+		return false;
+	
+	if(m_ListSize + 10 + 2 * sizeof(pImage) > SSD1306_DISPLAY_LIST_SIZE)
+	{
+		m_ListOverflow = true;
+		return true;
+	}
+	
+	uint16_t args[] = {(uint16_t)x, (uint16_t)y, width, height};
+	m_List[m_ListSize++] = _CMD_BITMAP;
+	m_List[m_ListSize++] = op;
+	for(uint8_t i = 0; i < 4; ++i)
+	{
+		m_List[m_ListSize++] = args[i] & 0xFF;
+		m_List[m_ListSize++] = args[i] >> 8;
+	}
+	memcpy(m_List + m_ListSize, &pImage, sizeof(pImage));
+	m_ListSize += sizeof(pImage);
+	memcpy(m_List + m_ListSize, &pMask, sizeof(pMask));
+	m_ListSize += sizeof(pMask);
+	m_LastText = NO_TEXT_RECORD;
+	
+	return true;
+}
+
+// Renders into m_Buffer the part of display list which falls on the page. Records which can't reach the page are skipped
+void SSD1306_oled::replay(uint8_t page)
+{
+	memset(m_Buffer, 0, BUFFER_SIZE);
+	m_BufPage = page;
+	m_Replaying = true;
+	
+	int16_t curX = m_CurX, curY = m_CurY;
+	int16_t clipX0 = m_ClipX0, clipY0 = m_ClipY0, clipX1 = m_ClipX1, clipY1 = m_ClipY1;
+	m_ClipX0 = 0;                                                      // Display list begins with the whole screen
+	m_ClipY0 = 0;
+	m_ClipX1 = DISPLAY_WIDTH - 1;
+	m_ClipY1 = DISPLAY_HEIGHT - 1;
+	
+	for(uint16_t pos = 0; pos < m_ListSize; )
+	{
+		uint8_t cmd = m_List[pos];
+		if(_CMD_TEXT == cmd || _CMD_PAGE_TEXT == cmd)
+		{
+			uint8_t font = m_List[pos + 1], count = m_List[pos + 6];
+			uint8_t height = _CMD_TEXT == cmd ? m_ListFonts[font].m_Height : m_ListPageFonts[font].m_Height;
+			
+			m_CurX = read_arg(m_List + pos + 2);
+			m_CurY = read_arg(m_List + pos + 4);
+			if(rows_on_page(m_CurY, m_CurY + height - 1, page))
+			{
+				for(uint8_t i = 0; i < count; ++i)
+				{
+					if(_CMD_TEXT == cmd)
+						write_char(m_List[pos + 7 + i], m_ListFonts[font]);
+					else
+						write_char(m_List[pos + 7 + i], m_ListPageFonts[font]);
+				}
+			}
+			pos += 7 + count;
+			continue;
+		}
+		if(_CMD_POLYGON == cmd)
+		{
+			uint8_t mode = m_List[pos + 1], count = m_List[pos + 2];
+			int16_t points[2 * LIST_POLYGON_POINTS];
+			int16_t yMin = INT16_MAX, yMax = INT16_MIN;
+			
+			for(uint8_t i = 0; i < 2 * count; ++i)
+			{
+				points[i] = read_arg(m_List + pos + 3 + 2 * i);
+				if(i & 1)
+				{
+					if(points[i] < yMin)
+						yMin = points[i];
+					if(points[i] > yMax)
+						yMax = points[i];
+				}
+			}
+			if(rows_on_page(yMin, yMax, page))
+			{
+				if(0xFF == mode)
+					draw_polygon(points, count);
+				else
+					draw_fill_polygon(points, count, (DRAW_MODE)mode);
+			}
+			pos += 3 + 4 * count;
+			continue;
+		}
+		
+		if(_CMD_BITMAP == cmd)
+		{
+			const uint8_t *pImage, *pMask;
+			int16_t y = read_arg(m_List + pos + 4);
+			uint16_t height = read_arg(m_List + pos + 8);
+			
+			memcpy(&pImage, m_List + pos + 10, sizeof(pImage));
+			memcpy(&pMask, m_List + pos + 10 + sizeof(pImage), sizeof(pMask));
+			if(rows_on_page(y, y + height - 1, page))
+				draw_bitmap(read_arg(m_List + pos + 2), y, read_arg(m_List + pos + 6), height, pImage, (RASTER_OP)m_List[pos + 1], pMask);
+			pos += 10 + 2 * sizeof(pImage);
+			continue;
+		}
+		
+		int16_t a[7];                                                    // Coordinates are signed, sizes are unsigned
+		for(uint8_t i = 0; i < DRAW_COMMAND_ARGS[cmd]; ++i)
+			a[i] = read_arg(m_List + pos + 1 + 2 * i);
+		pos += 1 + 2 * DRAW_COMMAND_ARGS[cmd];
+		
+		switch(cmd)
+		{
+			case _CMD_PIXEL:
+				draw_pixel(a[0], a[1]);
+			break;
+			case _CMD_PIXEL_INVERTED:
+				draw_pixel_inverted(a[0], a[1]);
+			break;
+			case _CMD_HORISONTAL_LINE:
+				if(rows_on_page(a[1], a[1] + (uint16_t)a[3] - 1, page))
+					draw_horisontal_line(a[0], a[1], a[2], a[3]);
+			break;
+			case _CMD_VERTICAL_LINE:
+				if(rows_on_page(a[1], a[1] + (uint16_t)a[2] - 1, page))
+					draw_vertical_line(a[0], a[1], a[2], a[3]);
+			break;
+			case _CMD_LINE:
+				if(rows_on_page(a[1] < a[3] ? a[1] : a[3], a[1] < a[3] ? a[3] : a[1], page))
+					draw_line(a[0], a[1], a[2], a[3]);
+			break;
+			case _CMD_RECTANGLE:
+				if(rows_on_page(a[1], a[1] + (uint16_t)a[3] + (uint16_t)a[4], page))
+					draw_rectangle(a[0], a[1], a[2], a[3], a[4]);
+			break;
+			case _CMD_FILL_RECTANGLE:
+				if(rows_on_page(a[1], a[1] + (uint16_t)a[3] - 1, page))
+					draw_fill_rectangle(a[0], a[1], a[2], a[3], (DRAW_MODE)a[4]);
+			break;
+			case _CMD_TRIANGLE:
+			case _CMD_FILL_TRIANGLE:
+			{
+				int16_t yMin = a[1], yMax = a[1];
+				for(uint8_t i = 3; i < 6; i += 2)
+				{
+					if(a[i] < yMin)
+						yMin = a[i];
+					if(a[i] > yMax)
+						yMax = a[i];
+				}
+				if(!rows_on_page(yMin, yMax, page))
+					break;
+				if(_CMD_TRIANGLE == cmd)
+					draw_triangle(a[0], a[1], a[2], a[3], a[4], a[5]);
+				else
+					draw_fill_triangle(a[0], a[1], a[2], a[3], a[4], a[5], (DRAW_MODE)a[6]);
+			}
+			break;
+			case _CMD_CIRCLE:
+			case _CMD_FILL_CIRCLE:
+				if(!rows_on_page(a[1] - (uint16_t)a[2], a[1] + (uint16_t)a[2], page))
+					break;
+				if(_CMD_CIRCLE == cmd)
+					draw_circle(a[0], a[1], a[2]);
+				else
+					draw_fill_circle(a[0], a[1], a[2], (DRAW_MODE)a[3]);
+			break;
+			case _CMD_CLIP:
+				m_ClipX0 = a[0];
+				m_ClipY0 = a[1];
+				m_ClipX1 = a[2];
+				m_ClipY1 = a[3];
+			break;
+		}
+	}
+	m_CurX = curX;
+	m_CurY = curY;
+	m_ClipX0 = clipX0;
+	m_ClipY0 = clipY0;
+	m_ClipX1 = clipX1;
+	m_ClipY1 = clipY1;
+	m_Replaying = false;
 }
+#endif
 
 SSD1306_oled& SSD1306_oled::operator << (const char ch)
 {
@@ -452,18 +2374,11 @@ void SSD1306_oled::set_precision(uint8_t precision)
 
 void over(SSD1306_oled &Obj)
 {
-	switch(Obj.m_DefFont)
-	{
-		case _7x10:
-			Obj.write_string(Obj.cBuf, Font_7x10);
-		break;
-		case _11x18:
-			Obj.write_string(Obj.cBuf, Font_11x18);
-		break;
-		case _16x26:
-			Obj.write_string(Obj.cBuf, Font_16x26);
-		break;
-			
-	}
+#if SSD1306_CONSOLE
+	if(Obj.m_Console)
+		Obj.console_write(Obj.cBuf);
+	else
+#endif
+		Obj.write_string(Obj.cBuf, font_def(Obj.m_DefFont));
 	Obj.cBuf.clear_buffer();
 }
@@ -0,0 +1,274 @@
+#include "ssd1306_bus.h"
+
+SSD1306_bus::SSD1306_bus(I2C_HandleTypeDef *hi2c, uint16_t mux_addr):
+		m_I2C_Port(hi2c), m_MuxAddress(mux_addr << 1), m_MuxSelected(MUX_UNKNOWN), m_MuxByte(0), m_PanelsCount(0), m_LastServed(0),
+		m_pActive(0), m_Chunk(0), m_MuxPhase(false), m_Busy(false), m_SyncWaiting(false)
+	{
+	}
+
+bool SSD1306_bus::attach(SSD1306_bus_panel &Panel)
+{
+	if(PANELS_COUNT == m_PanelsCount)
+		return false;
+
+	m_Panels[m_PanelsCount++] = &Panel;
+	return true;
+}
+
+// Takes the bus if it's free. Interrupts are disabled for the test-and-set, because the completion
+// interrupt and the main loop both start transactions. PRIMASK is restored, so the caller may run with interrupts disabled
+bool SSD1306_bus::claim()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	bool bFree = !m_Busy;
+	m_Busy = true;
+	__set_PRIMASK(primask);
+
+	return bFree;
+}
+
+// Takes the bus for a synchronous transaction. Queued updates give the bus up after their current chunk,
+// the wait is limited by SSD1306_BUS_WAIT
+bool SSD1306_bus::take()
+{
+	uint32_t start = HAL_GetTick();
+
+	m_SyncWaiting = true;
+	while(!claim())
+	{
+		if(HAL_GetTick() - start >= WAIT_TIMEOUT)
+		{
+			m_SyncWaiting = false;
+			return false;
+		}
+	}
+	m_SyncWaiting = false;
+
+	return true;
+}
+
+// Queued panel which goes next: the highest priority wins, the turn goes round among the same priorities
+SSD1306_bus_panel *SSD1306_bus::pick()
+{
+	uint32_t tick = HAL_GetTick();
+	SSD1306_bus_panel *pBest = 0;
+	uint8_t best = 0;
+
+	for(uint8_t i = 1; i <= m_PanelsCount; ++i)
+	{
+		uint8_t index = (m_LastServed + i) % m_PanelsCount;
+		SSD1306_bus_panel *pPanel = m_Panels[index];
+		if(pPanel->ready(tick) && (!pBest || pPanel->m_Priority > pBest->m_Priority))
+		{
+			pBest = pPanel;
+			best = index;
+		}
+	}
+	if(pBest)
+		m_LastServed = best;
+
+	return pBest;
+}
+
+// Starts the next chunk if there is one, otherwise releases the bus. The bus must be taken
+void SSD1306_bus::start_next()
+{
+	while(!m_SyncWaiting)
+	{
+		m_pActive = pick();
+		if(!m_pActive)
+			break;
+		if(HAL_OK == start_chunk())
+			return;
+		fail(*m_pActive);
+	}
+	m_pActive = 0;
+	m_Busy = false;
+}
+
+// Starts the chunk of the active panel, or the mux selection before it
+HAL_StatusTypeDef SSD1306_bus::start_chunk()
+{
+	SSD1306_bus_panel &Panel = *m_pActive;
+
+	m_MuxPhase = m_MuxAddress && Panel.m_MuxMask && Panel.m_MuxMask != m_MuxSelected;
+	if(m_MuxPhase)
+	{
+		m_MuxByte = Panel.m_MuxMask;
+		if(_IT_TRANSFER == Panel.m_Mode)
+			return HAL_I2C_Master_Transmit_IT(m_I2C_Port, m_MuxAddress, &m_MuxByte, 1);
+		return HAL_I2C_Master_Transmit_DMA(m_I2C_Port, m_MuxAddress, &m_MuxByte, 1);
+	}
+
+	if(!Panel.m_FrameStarted)
+	{
+		Panel.m_FrameStarted = true;
+		Panel.m_FrameBeg = HAL_GetTick();
+	}
+	m_Chunk = Panel.m_Data && Panel.m_Size > CHUNK_SIZE ? CHUNK_SIZE : Panel.m_Size;   // Command stream isn't split
+	uint16_t nMemAddress = Panel.m_Data ? DATA_TO_SEND : COMMAND_TO_SEND;
+	if(_IT_TRANSFER == Panel.m_Mode)
+		return HAL_I2C_Mem_Write_IT(m_I2C_Port, Panel.m_SSD1306_I2C_Address, nMemAddress, sizeof(uint8_t), Panel.m_pData, m_Chunk);
+
+	return HAL_I2C_Mem_Write_DMA(m_I2C_Port, Panel.m_SSD1306_I2C_Address, nMemAddress, sizeof(uint8_t), Panel.m_pData, m_Chunk);
+}
+
+// Drops the queued update of the panel, the display sends the frame again with the next update
+void SSD1306_bus::fail(SSD1306_bus_panel &Panel)
+{
+	Panel.m_Queued = false;
+	Panel.m_FrameStarted = false;
+	m_MuxSelected = MUX_UNKNOWN;
+	if(Panel.m_pDisplay)
+		Panel.m_pDisplay->transfer_error(&Panel);
+}
+
+void SSD1306_bus::request()
+{
+	if(claim())
+		start_next();
+}
+
+HAL_StatusTypeDef SSD1306_bus::select_mux(const SSD1306_bus_panel &Panel, uint32_t timeout)
+{
+	if(!m_MuxAddress || !Panel.m_MuxMask || Panel.m_MuxMask == m_MuxSelected)
+		return HAL_OK;
+
+	m_MuxByte = Panel.m_MuxMask;
+	HAL_StatusTypeDef status = HAL_I2C_Master_Transmit(m_I2C_Port, m_MuxAddress, &m_MuxByte, 1, timeout);
+	m_MuxSelected = HAL_OK == status ? m_MuxByte : MUX_UNKNOWN;
+
+	return status;
+}
+
+HAL_StatusTypeDef SSD1306_bus::write(SSD1306_bus_panel &Panel, bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout)
+{
+	if(!take())
+		return HAL_BUSY;
+
+	HAL_StatusTypeDef status = select_mux(Panel, timeout);
+	if(HAL_OK == status)
+		status = HAL_I2C_Mem_Write(m_I2C_Port, Panel.m_SSD1306_I2C_Address, bData ? DATA_TO_SEND : COMMAND_TO_SEND, sizeof(uint8_t),
+		                           pData, nSize, timeout);
+	start_next();                                            // Updates queued meanwhile go on
+
+	return status;
+}
+
+bool SSD1306_bus::probe(SSD1306_bus_panel &Panel)
+{
+	if(!take())
+		return false;
+
+	bool bReady = HAL_OK == select_mux(Panel, 1000) && HAL_OK == HAL_I2C_IsDeviceReady(m_I2C_Port, Panel.m_SSD1306_I2C_Address, 5, 1000);
+	start_next();
+
+	return bReady;
+}
+
+// Starts the queued updates which have waited for their frame interval. Call it from the main loop or a timer tick
+void SSD1306_bus::service()
+{
+	request();
+}
+
+bool SSD1306_bus::is_busy() const
+{
+	return m_Busy;
+}
+
+// Must be called from HAL_I2C_MemTxCpltCallback() and HAL_I2C_MasterTxCpltCallback()
+void SSD1306_bus::transfer_complete(I2C_HandleTypeDef *hi2c)
+{
+	if(hi2c != m_I2C_Port || !m_pActive)
+		return;
+
+	SSD1306_bus_panel &Panel = *m_pActive;
+	if(m_MuxPhase)
+	{
+		m_MuxSelected = m_MuxByte;
+		if(HAL_OK == start_chunk())
+			return;
+		fail(Panel);
+		start_next();
+		return;
+	}
+
+	Panel.m_pData += m_Chunk;
+	Panel.m_Size -= m_Chunk;
+	if(!Panel.m_Size)
+	{
+		Panel.m_Queued = false;
+		if(Panel.m_pDisplay)
+			Panel.m_pDisplay->transfer_complete(&Panel);       // Next transaction of the update is queued from here
+		if(!Panel.m_Queued)
+			Panel.m_FrameStarted = false;
+	}
+	start_next();
+}
+
+// Must be called from HAL_I2C_ErrorCallback()
+void SSD1306_bus::transfer_error(I2C_HandleTypeDef *hi2c)
+{
+	if(hi2c != m_I2C_Port || !m_pActive)
+		return;
+
+	fail(*m_pActive);
+	start_next();
+}
+
+SSD1306_bus_panel::SSD1306_bus_panel(SSD1306_bus &Bus, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN, uint8_t priority,
+                                     uint16_t frame_interval, int8_t mux_channel):
+		m_Bus(Bus), m_SSD1306_I2C_Address(i2c_addr << 1), m_GPIO_Port(GPIOx), m_GPIO_Pin(GPIO_PIN),
+		m_MuxMask(mux_channel < 0 ? 0 : 1 << mux_channel), m_Priority(priority), m_FrameInterval(frame_interval), m_pDisplay(0),
+		m_Queued(false), m_Data(false), m_pData(0), m_Size(0), m_Mode(_DMA_TRANSFER), m_FrameStarted(false),
+		m_FrameBeg(0 - (uint32_t)frame_interval)
+	{
+		m_Bus.attach(*this);
+	}
+
+// Queued transaction may go: the update is going on already or its frame interval is over
+bool SSD1306_bus_panel::ready(uint32_t tick) const
+{
+	return m_Queued && (m_FrameStarted || tick - m_FrameBeg >= m_FrameInterval);
+}
+
+void SSD1306_bus_panel::attach(SSD1306_oled &Display)
+{
+	m_pDisplay = &Display;
+}
+
+bool SSD1306_bus_panel::probe()
+{
+	return m_Bus.probe(*this);
+}
+
+void SSD1306_bus_panel::set_reset(bool bActive)
+{
+	if(m_GPIO_Port)
+		HAL_GPIO_WritePin(m_GPIO_Port, m_GPIO_Pin, bActive ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+HAL_StatusTypeDef SSD1306_bus_panel::write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout)
+{
+	return m_Bus.write(*this, bData, pData, nSize, timeout);
+}
+
+// Transaction is queued and goes when the bus and the frame interval let it
+HAL_StatusTypeDef SSD1306_bus_panel::write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode)
+{
+	m_Data = bData;
+	m_pData = pData;
+	m_Size = nSize;
+	m_Mode = mode;
+	m_Queued = true;
+	m_Bus.request();
+
+	return HAL_OK;
+}
+
+const void *SSD1306_bus_panel::handle() const
+{
+	return this;
+}
@@ -0,0 +1,175 @@
+#include "ssd1306_queue.h"
+
+static const FontDef &font_def(uint8_t font)
+{
+	switch(font)
+	{
+		case _11x18:
+			return Font_11x18;
+		case _16x26:
+			return Font_16x26;
+		default:
+			return Font_7x10;
+	}
+}
+
+SSD1306_queue::SSD1306_queue(SSD1306_oled &Display):
+		m_Display(Display)
+	{
+		for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+		{
+			m_Lanes[lane].m_Head.store(0);
+			m_Lanes[lane].m_Tail.store(0);
+			m_Lanes[lane].m_Dropped.store(0);
+		}
+	}
+
+// Copies the command into the lane. Must be called only by the owner of the lane. The command is published
+// by the release store of the head, the render task sees it complete
+bool SSD1306_queue::post(uint8_t lane, const Command &Cmd)
+{
+	if(lane >= LANES_COUNT)
+		return false;
+
+	Lane &L = m_Lanes[lane];
+	uint8_t head = L.m_Head.load(std::memory_order_relaxed);
+	if((uint8_t)(head - L.m_Tail.load(std::memory_order_acquire)) == LANE_DEPTH)
+	{
+		L.m_Dropped.store(L.m_Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	L.m_Ring[head & (LANE_DEPTH - 1)] = Cmd;
+	L.m_Head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+SSD1306_queue::Command SSD1306_queue::make(QUEUE_COMMAND type, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	Command Cmd;
+	memset(&Cmd, 0, sizeof(Cmd));
+	Cmd.m_Type = type;
+	Cmd.m_X0 = x0;
+	Cmd.m_Y0 = y0;
+	Cmd.m_X1 = x1;
+	Cmd.m_Y1 = y1;
+
+	return Cmd;
+}
+
+// Text is cut to 11 chars
+bool SSD1306_queue::post_text(uint8_t lane, int16_t x, int16_t y, FONT font, const char *pText)
+{
+	Command Cmd = make(_QCMD_TEXT, x, y);
+	Cmd.m_Arg = font;
+	strncpy(Cmd.m_Text, pText, TEXT_SIZE - 1);
+
+	return post(lane, Cmd);
+}
+
+// Value is formatted by the render task, so producers don't need the formatting state of SSD1306_oled
+bool SSD1306_queue::post_number(uint8_t lane, int16_t x, int16_t y, FONT font, int32_t value, uint8_t width, uint8_t decimals)
+{
+	Command Cmd = make(_QCMD_NUMBER, x, y);
+	Cmd.m_Arg = font;
+	Cmd.m_Width = width;
+	Cmd.m_Decimals = decimals;
+	Cmd.m_Value = value;
+
+	return post(lane, Cmd);
+}
+
+bool SSD1306_queue::post_pixel(uint8_t lane, int16_t x, int16_t y)
+{
+	return post(lane, make(_QCMD_PIXEL, x, y));
+}
+
+bool SSD1306_queue::post_line(uint8_t lane, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	return post(lane, make(_QCMD_LINE, x0, y0, x1, y1));
+}
+
+bool SSD1306_queue::post_rectangle(uint8_t lane, int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+	return post(lane, make(_QCMD_RECTANGLE, x, y, width, height));
+}
+
+bool SSD1306_queue::post_fill_rectangle(uint8_t lane, int16_t x, int16_t y, uint16_t width, uint16_t height, DRAW_MODE mode)
+{
+	Command Cmd = make(_QCMD_FILL_RECTANGLE, x, y, width, height);
+	Cmd.m_Arg = mode;
+
+	return post(lane, Cmd);
+}
+
+uint16_t SSD1306_queue::dropped(uint8_t lane) const
+{
+	return lane < LANES_COUNT ? m_Lanes[lane].m_Dropped.load(std::memory_order_relaxed) : 0;
+}
+
+void SSD1306_queue::draw(const Command &Cmd)
+{
+	switch(Cmd.m_Type)
+	{
+		case _QCMD_TEXT:
+			m_Display.set_cursor(Cmd.m_X0, Cmd.m_Y0);
+			m_Display.write_string(Cmd.m_Text, font_def(Cmd.m_Arg));
+		break;
+		case _QCMD_NUMBER:
+		{
+			SSD1306_oled::NumberField Field;
+			m_Display.init_number(Field, Cmd.m_X0, Cmd.m_Y0, font_def(Cmd.m_Arg), Cmd.m_Width, Cmd.m_Decimals);
+			m_Display.draw_number(Field, Cmd.m_Value);
+		}
+		break;
+		case _QCMD_PIXEL:
+			m_Display.draw_pixel(Cmd.m_X0, Cmd.m_Y0);
+		break;
+		case _QCMD_LINE:
+			m_Display.draw_line(Cmd.m_X0, Cmd.m_Y0, Cmd.m_X1, Cmd.m_Y1);
+		break;
+		case _QCMD_RECTANGLE:
+			m_Display.draw_rectangle(Cmd.m_X0, Cmd.m_Y0, Cmd.m_X1, Cmd.m_Y1);
+		break;
+		case _QCMD_FILL_RECTANGLE:
+			m_Display.draw_fill_rectangle(Cmd.m_X0, Cmd.m_Y0, Cmd.m_X1, Cmd.m_Y1, (DRAW_MODE)Cmd.m_Arg);
+		break;
+		default:
+		break;
+	}
+}
+
+// Must be called by the render task only. Draws the posted commands lane by lane, every lane in its order
+// (commands of different lanes aren't ordered), and then commits all of them by one update_dirty(). Asynchronous commit
+// is skipped while the previous transfer runs, the next render() sends it. Without SSD1306_DOUBLE_BUFFER and in tiled
+// mode the commit is always synchronous. Returns the count of drawn commands
+uint16_t SSD1306_queue::render(bool bAsync)
+{
+	uint16_t count = 0;
+
+	for(uint8_t lane = 0; lane < LANES_COUNT; ++lane)
+	{
+		Lane &L = m_Lanes[lane];
+		uint8_t tail = L.m_Tail.load(std::memory_order_relaxed);
+		uint8_t head = L.m_Head.load(std::memory_order_acquire);
+		for( ; tail != head; ++tail, ++count)
+		{
+			draw(L.m_Ring[tail & (LANE_DEPTH - 1)]);
+			L.m_Tail.store(tail + 1, std::memory_order_release);   // Slot is free for the producer
+		}
+	}
+
+#if SSD1306_DOUBLE_BUFFER
+	if(bAsync)
+	{
+		m_Display.update_dirty_async();
+		return count;
+	}
+#else
+	(void)bAsync;
+#endif
+	if(count)
+		m_Display.update_dirty();
+
+	return count;
+}
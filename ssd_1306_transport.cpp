@@ -0,0 +1,101 @@
+#include "ssd1306_transport.h"
+
+SSD1306_i2c::SSD1306_i2c(I2C_HandleTypeDef *hi2c, uint16_t i2c_addr, GPIO_TypeDef* GPIOx, uint16_t GPIO_PIN):
+		m_I2C_Port(hi2c),	m_SSD1306_I2C_Address(i2c_addr << 1), m_GPIO_Port(GPIOx), m_GPIO_Pin(GPIO_PIN)
+	{
+	}
+
+bool SSD1306_i2c::probe()
+{
+	return HAL_I2C_IsDeviceReady(m_I2C_Port, m_SSD1306_I2C_Address, 5, 1000) == HAL_OK;  // Check if OLED connected to I2C
+}
+
+void SSD1306_i2c::set_reset(bool bActive)
+{
+	if(m_GPIO_Port)
+		HAL_GPIO_WritePin(m_GPIO_Port, m_GPIO_Pin, bActive ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+HAL_StatusTypeDef SSD1306_i2c::write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout)
+{
+	return HAL_I2C_Mem_Write(m_I2C_Port, m_SSD1306_I2C_Address, bData ? DATA_TO_SEND : COMMAND_TO_SEND, sizeof(uint8_t), pData, nSize, timeout);
+}
+
+HAL_StatusTypeDef SSD1306_i2c::write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode)
+{
+	uint16_t nMemAddress = bData ? DATA_TO_SEND : COMMAND_TO_SEND;
+
+	if(_IT_TRANSFER == mode)
+		return HAL_I2C_Mem_Write_IT(m_I2C_Port, m_SSD1306_I2C_Address, nMemAddress, sizeof(uint8_t), pData, nSize);
+
+	return HAL_I2C_Mem_Write_DMA(m_I2C_Port, m_SSD1306_I2C_Address, nMemAddress, sizeof(uint8_t), pData, nSize);
+}
+
+const void *SSD1306_i2c::handle() const
+{
+	return m_I2C_Port;
+}
+
+SSD1306_spi::SSD1306_spi(SPI_HandleTypeDef *hspi, GPIO_TypeDef* DC_GPIOx, uint16_t DC_GPIO_PIN, GPIO_TypeDef* CS_GPIOx, uint16_t CS_GPIO_PIN,
+                         GPIO_TypeDef* Reset_GPIOx, uint16_t Reset_GPIO_PIN):
+		m_SPI_Port(hspi), m_DC_Port(DC_GPIOx), m_DC_Pin(DC_GPIO_PIN), m_CS_Port(CS_GPIOx), m_CS_Pin(CS_GPIO_PIN),
+		m_Reset_Port(Reset_GPIOx), m_Reset_Pin(Reset_GPIO_PIN)
+	{
+	}
+
+// D/C is sampled with the last bit of every byte, so it's set before the transaction begins
+void SSD1306_spi::select(bool bData)
+{
+	HAL_GPIO_WritePin(m_DC_Port, m_DC_Pin, bData ? GPIO_PIN_SET : GPIO_PIN_RESET);
+	if(m_CS_Port)
+		HAL_GPIO_WritePin(m_CS_Port, m_CS_Pin, GPIO_PIN_RESET);
+}
+
+// SPI has no acknowledge, so the controller can't be detected. The chip select is released here,
+// it may be left low by an interrupted transfer
+bool SSD1306_spi::probe()
+{
+	complete();
+	return true;
+}
+
+void SSD1306_spi::set_reset(bool bActive)
+{
+	if(m_Reset_Port)
+		HAL_GPIO_WritePin(m_Reset_Port, m_Reset_Pin, bActive ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+HAL_StatusTypeDef SSD1306_spi::write(bool bData, uint8_t *pData, uint16_t nSize, uint32_t timeout)
+{
+	select(bData);
+	HAL_StatusTypeDef status = HAL_SPI_Transmit(m_SPI_Port, pData, nSize, timeout);
+	complete();
+
+	return status;
+}
+
+HAL_StatusTypeDef SSD1306_spi::write_async(bool bData, uint8_t *pData, uint16_t nSize, ASYNC_TRANSFER mode)
+{
+	HAL_StatusTypeDef status;
+
+	select(bData);
+	if(_IT_TRANSFER == mode)
+		status = HAL_SPI_Transmit_IT(m_SPI_Port, pData, nSize);
+	else
+		status = HAL_SPI_Transmit_DMA(m_SPI_Port, pData, nSize);
+	if(HAL_OK != status)
+		complete();
+
+	return status;
+}
+
+void SSD1306_spi::complete()
+{
+	if(m_CS_Port)
+		HAL_GPIO_WritePin(m_CS_Port, m_CS_Pin, GPIO_PIN_SET);
+}
+
+const void *SSD1306_spi::handle() const
+{
+	return m_SPI_Port;
+}
@@ -0,0 +1,325 @@
+#include "ssd1306_widgets.h"
+
+// Sine of 0...90 degrees in 16 steps, 256 is 1.0
+static const uint16_t QUARTER_SINE[] = {0, 25, 50, 74, 98, 121, 142, 162, 181, 198, 213, 226, 237, 245, 251, 255, 256};
+
+// Sine of angle 0...64 (0...90 degrees) with linear interpolation between the table steps
+static int16_t quarter_sine(uint8_t angle)
+{
+	uint8_t step = angle >> 2;
+	if(step >= 16)
+		return QUARTER_SINE[16];
+
+	return QUARTER_SINE[step] + (((QUARTER_SINE[step + 1] - QUARTER_SINE[step]) * (angle & 3)) >> 2);
+}
+
+// Length multiplied by the 256-based fraction and rounded
+static int16_t scale_q8(int16_t fraction, uint16_t length)
+{
+	int32_t value = (int32_t)fraction * length;
+
+	return value < 0 ? -((-value + 128) >> 8) : (value + 128) >> 8;
+}
+
+SSD1306_scene::SSD1306_scene(SSD1306_oled &Display):
+		m_Display(Display), m_DamageCount(0)
+	{
+		for(uint8_t i = 0; i < WIDGETS_COUNT; ++i)
+			m_Widgets[i].m_Type = _WIDGET_NONE;
+	}
+
+// Takes a free widget of the pool. Returns its id or -1 if the pool is full
+int8_t SSD1306_scene::add(WIDGET_TYPE type, int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+	for(uint8_t id = 0; id < WIDGETS_COUNT; ++id)
+	{
+		Widget &W = m_Widgets[id];
+		if(_WIDGET_NONE != W.m_Type)
+			continue;
+
+		memset(&W, 0, sizeof(W));
+		W.m_Type = type;
+		W.m_Visible = true;
+		W.m_X = x;
+		W.m_Y = y;
+		W.m_Width = width;
+		W.m_Height = height;
+		W.m_Max = 1;
+		damage_widget(id);
+		return id;
+	}
+
+	return -1;
+}
+
+bool SSD1306_scene::valid(int8_t id) const
+{
+	return id >= 0 && id < WIDGETS_COUNT && _WIDGET_NONE != m_Widgets[id].m_Type;
+}
+
+void SSD1306_scene::damage_widget(int8_t id)
+{
+	const Widget &W = m_Widgets[id];
+	if(W.m_Visible)
+		damage(W.m_X, W.m_Y, W.m_Width, W.m_Height);
+}
+
+int8_t SSD1306_scene::add_label(int16_t x, int16_t y, const FontDef &Font, const char *pText)
+{
+	int8_t id = add(_WIDGET_LABEL, x, y, 0, Font.m_Height);
+	if(id < 0)
+		return id;
+
+	m_Widgets[id].m_pFont = &Font;
+	set_text(id, pText);
+	return id;
+}
+
+// Bar is the outline of the bounds and the inner part filled in proportion to value / max
+int8_t SSD1306_scene::add_bar(int16_t x, int16_t y, uint16_t width, uint16_t height, int16_t max)
+{
+	int8_t id = add(_WIDGET_BAR, x, y, width, height);
+	if(id >= 0 && max > 0)
+		m_Widgets[id].m_Max = max;
+
+	return id;
+}
+
+// Gauge is the upper half of a circle with the center at x + radius, y + radius and the needle,
+// which goes from the left (0) to the right (max)
+int8_t SSD1306_scene::add_gauge(int16_t x, int16_t y, uint16_t radius, int16_t max)
+{
+	int8_t id = add(_WIDGET_GAUGE, x, y, 2 * radius + 1, radius + 1);
+	if(id >= 0 && max > 0)
+		m_Widgets[id].m_Max = max;
+
+	return id;
+}
+
+int8_t SSD1306_scene::add_icon(int16_t x, int16_t y, uint16_t width, uint16_t height, const uint8_t *pImage, const uint8_t *pMask)
+{
+	int8_t id = add(_WIDGET_ICON, x, y, width, height);
+	if(id < 0)
+		return id;
+
+	m_Widgets[id].m_pImage = pImage;
+	m_Widgets[id].m_pMask = pMask;
+	return id;
+}
+
+void SSD1306_scene::remove(int8_t id)
+{
+	if(!valid(id))
+		return;
+
+	damage_widget(id);
+	m_Widgets[id].m_Type = _WIDGET_NONE;
+}
+
+// Label width follows the text, so both the old and the new bounds are damaged
+void SSD1306_scene::set_text(int8_t id, const char *pText)
+{
+	if(!valid(id) || _WIDGET_LABEL != m_Widgets[id].m_Type)
+		return;
+
+	Widget &W = m_Widgets[id];
+	if(!strncmp(W.m_Text, pText, LABEL_SIZE - 1) && W.m_Width)
+		return;
+
+	damage_widget(id);
+	strncpy(W.m_Text, pText, LABEL_SIZE - 1);
+	W.m_Text[LABEL_SIZE - 1] = 0;
+	W.m_Width = strlen(W.m_Text) * W.m_pFont->m_Width;
+	damage_widget(id);
+}
+
+void SSD1306_scene::set_value(int8_t id, int16_t value)
+{
+	if(!valid(id))
+		return;
+
+	Widget &W = m_Widgets[id];
+	if(value < 0)
+		value = 0;
+	if(value > W.m_Max)
+		value = W.m_Max;
+	if(value == W.m_Value)
+		return;
+
+	W.m_Value = value;
+	damage_widget(id);
+}
+
+void SSD1306_scene::set_visible(int8_t id, bool bVisible)
+{
+	if(!valid(id) || m_Widgets[id].m_Visible == bVisible)
+		return;
+
+	damage_widget(id);
+	m_Widgets[id].m_Visible = bVisible;
+	damage_widget(id);
+}
+
+void SSD1306_scene::move(int8_t id, int16_t x, int16_t y)
+{
+	if(!valid(id))
+		return;
+
+	damage_widget(id);
+	m_Widgets[id].m_X = x;
+	m_Widgets[id].m_Y = y;
+	damage_widget(id);
+}
+
+bool SSD1306_scene::touch(const Rect &A, const Rect &B)
+{
+	return A.m_X0 <= B.m_X1 + 1 && B.m_X0 <= A.m_X1 + 1 && A.m_Y0 <= B.m_Y1 + 1 && B.m_Y0 <= A.m_Y1 + 1;
+}
+
+SSD1306_scene::Rect SSD1306_scene::join(const Rect &A, const Rect &B)
+{
+	Rect R = A;
+
+	if(B.m_X0 < R.m_X0)
+		R.m_X0 = B.m_X0;
+	if(B.m_Y0 < R.m_Y0)
+		R.m_Y0 = B.m_Y0;
+	if(B.m_X1 > R.m_X1)
+		R.m_X1 = B.m_X1;
+	if(B.m_Y1 > R.m_Y1)
+		R.m_Y1 = B.m_Y1;
+	return R;
+}
+
+int32_t SSD1306_scene::area(const Rect &R)
+{
+	return (int32_t)(R.m_X1 - R.m_X0 + 1) * (R.m_Y1 - R.m_Y0 + 1);
+}
+
+// Adds the rectangle to the damaged ones. Rows are widened to whole pages, because pages are the unit of transmission.
+// Rectangle overlapping or touching a damaged one is joined with it. When there is no room for one more rectangle,
+// it is joined with the one which grows least
+void SSD1306_scene::damage(int16_t x, int16_t y, uint16_t width, uint16_t height)
+{
+	int32_t xEnd = (int32_t)x + width - 1, yEnd = (int32_t)y + height - 1;
+	if(!width || !height || x > SSD1306_WIDTH - 1 || y > SSD1306_HEIGHT - 1 || xEnd < 0 || yEnd < 0)
+		return;
+
+	Rect R;
+	R.m_X0 = x < 0 ? 0 : x;
+	R.m_Y0 = (y < 0 ? 0 : y) & ~7;
+	R.m_X1 = xEnd > SSD1306_WIDTH - 1 ? SSD1306_WIDTH - 1 : xEnd;
+	R.m_Y1 = (yEnd > SSD1306_HEIGHT - 1 ? SSD1306_HEIGHT - 1 : yEnd) | 7;
+
+	while(true)                                              // Joined rectangle may touch others, so joining goes on
+	{
+		uint8_t joined = 0;
+		while(joined < m_DamageCount && !touch(R, m_Damage[joined]))
+			++joined;
+		if(joined == m_DamageCount)
+		{
+			if(m_DamageCount < DAMAGE_RECTS_COUNT)
+				break;
+			for(uint8_t i = 1, best = joined = 0; i < m_DamageCount; ++i)
+			{
+				if(area(join(R, m_Damage[i])) - area(m_Damage[i]) < area(join(R, m_Damage[best])) - area(m_Damage[best]))
+					joined = best = i;
+			}
+		}
+		R = join(R, m_Damage[joined]);
+		m_Damage[joined] = m_Damage[--m_DamageCount];
+	}
+	m_Damage[m_DamageCount++] = R;
+}
+
+void SSD1306_scene::damage_all()
+{
+	m_DamageCount = 0;
+	damage(0, 0, SSD1306_WIDTH, SSD1306_HEIGHT);
+}
+
+void SSD1306_scene::draw_gauge(const Widget &W)
+{
+	uint16_t radius = W.m_Height - 1;
+	int16_t x0 = W.m_X + radius, y0 = W.m_Y + radius;
+	uint8_t angle = (int32_t)W.m_Value * 128 / W.m_Max;      // 0...128 for 0...180 degrees from the left
+	int16_t cosine = angle <= 64 ? quarter_sine(64 - angle) : -quarter_sine(angle - 64);
+	int16_t sine = angle <= 64 ? quarter_sine(angle) : quarter_sine(128 - angle);
+	uint16_t length = radius > 2 ? radius - 2 : radius;
+
+	m_Display.draw_circle(x0, y0, radius);                   // Lower half is clipped by the widget bounds
+	m_Display.draw_line(x0, y0, x0 - scale_q8(cosine, length), y0 - scale_q8(sine, length));
+	m_Display.draw_fill_circle(x0, y0, 2);
+}
+
+// Draws the widget clipped by its bounds and the damaged rectangle
+void SSD1306_scene::draw_widget(const Widget &W, const Rect &Clip)
+{
+	int16_t x0 = W.m_X > Clip.m_X0 ? W.m_X : Clip.m_X0, y0 = W.m_Y > Clip.m_Y0 ? W.m_Y : Clip.m_Y0;
+	int32_t x1 = (int32_t)W.m_X + W.m_Width - 1, y1 = (int32_t)W.m_Y + W.m_Height - 1;
+	if(x1 > Clip.m_X1)
+		x1 = Clip.m_X1;
+	if(y1 > Clip.m_Y1)
+		y1 = Clip.m_Y1;
+	if(!W.m_Visible || x0 > x1 || y0 > y1)
+		return;
+
+	m_Display.set_clip(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+	switch(W.m_Type)
+	{
+		case _WIDGET_LABEL:
+			m_Display.set_cursor(W.m_X, W.m_Y);
+			m_Display.write_string(W.m_Text, *W.m_pFont);
+		break;
+		case _WIDGET_BAR:
+		{
+			int32_t fill = (int32_t)(W.m_Width - 4) * W.m_Value / W.m_Max;
+			m_Display.draw_rectangle(W.m_X, W.m_Y, W.m_Width - 1, W.m_Height - 1);
+			if(fill > 0 && W.m_Height > 4)
+				m_Display.draw_fill_rectangle(W.m_X + 2, W.m_Y + 2, fill, W.m_Height - 4);
+		}
+		break;
+		case _WIDGET_GAUGE:
+			draw_gauge(W);
+		break;
+		case _WIDGET_ICON:
+			m_Display.draw_bitmap(W.m_X, W.m_Y, W.m_Width, W.m_Height, W.m_pImage, _ROP_COPY, W.m_pMask);
+		break;
+		default:
+		break;
+	}
+}
+
+// Clears and redraws the damaged rectangles and transmits them. Drawing outside the widgets within
+// the damaged rectangles is lost. The clip rectangle of the display is reset. In tiled mode display list
+// is rebuilt every frame, so the whole scene is drawn and sent
+void SSD1306_scene::render()
+{
+#if SSD1306_TILED
+	m_Display.clear_buffer();
+	damage_all();
+#endif
+	for(uint8_t i = 0; i < m_DamageCount; ++i)
+	{
+		const Rect &R = m_Damage[i];
+		m_Display.set_clip(R.m_X0, R.m_Y0, R.m_X1 - R.m_X0 + 1, R.m_Y1 - R.m_Y0 + 1);
+		m_Display.draw_fill_rectangle(R.m_X0, R.m_Y0, R.m_X1 - R.m_X0 + 1, R.m_Y1 - R.m_Y0 + 1, _DRAW_CLEAR);
+		for(uint8_t id = 0; id < WIDGETS_COUNT; ++id)
+		{
+			if(_WIDGET_NONE != m_Widgets[id].m_Type)
+				draw_widget(m_Widgets[id], R);
+		}
+	}
+	m_Display.reset_clip();
+
+#if SSD1306_TILED
+	m_Display.update_screen();
+#else
+	for(uint8_t i = 0; i < m_DamageCount; ++i)
+	{
+		const Rect &R = m_Damage[i];
+		m_Display.update_region(R.m_X0, R.m_Y0, R.m_X1 - R.m_X0 + 1, R.m_Y1 - R.m_Y0 + 1);
+	}
+#endif
+	m_DamageCount = 0;
+}
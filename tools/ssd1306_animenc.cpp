@@ -0,0 +1,189 @@
+/*
+ * ssd1306_animenc.cpp
+ *
+ * Host tool encoding PBM images (P1 or P4) into the compressed animation stream for SSD1306_oled::draw_frame().
+ * Build it on the PC, e.g. g++ ssd1306_animenc.cpp -o ssd1306_animenc, and run
+ *   ./ssd1306_animenc [-i] [-s WxH] <array name> <output.cpp> frame1.pbm [frame2.pbm ...]
+ * Every frame is stored as a key frame or as XOR delta against the previous frame, whichever is shorter.
+ * Black PBM pixels are lit, -i inverts that. The screen size must match SSD1306_WIDTH x SSD1306_HEIGHT (128x64 by default).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Stream format, see SSD1306_oled::draw_frame()
+static const uint8_t FRAME_DELTA = 0x01;
+static const uint8_t FRAME_END = 0xFF;
+static const uint8_t FRAME_RUN_REPEAT = 0x80;
+static const uint8_t MAX_RUN = 128;
+static const uint8_t MIN_REPEAT = 3;                     // Shorter repeats are cheaper inside literal runs
+
+typedef std::vector<uint8_t> Bytes;
+
+// Next token of the PBM header, comments are skipped
+static bool read_token(FILE *pFile, char *pToken, size_t size)
+{
+	int ch = fgetc(pFile);
+	size_t len = 0;
+
+	while(EOF != ch && (' ' == ch || '\t' == ch || '\r' == ch || '\n' == ch || '#' == ch))
+	{
+		if('#' == ch)
+		{
+			while(EOF != ch && '\n' != ch)
+				ch = fgetc(pFile);
+		}
+		ch = fgetc(pFile);
+	}
+	while(EOF != ch && ' ' != ch && '\t' != ch && '\r' != ch && '\n' != ch && len + 1 < size)
+	{
+		pToken[len++] = ch;
+		ch = fgetc(pFile);
+	}
+	pToken[len] = 0;
+
+	return len != 0;
+}
+
+// Reads the PBM image into GDDRAM layout: pages of width column bytes, bit 0 is the top row of a page
+static bool read_pbm(const char *pFileName, int width, int height, bool bInvert, Bytes &frame)
+{
+	FILE *pFile = fopen(pFileName, "rb");
+	if(!pFile)
+		return false;
+
+	char magic[4], token[16];
+	bool bOk = read_token(pFile, magic, sizeof(magic)) && (!strcmp(magic, "P1") || !strcmp(magic, "P4"));
+	bOk = bOk && read_token(pFile, token, sizeof(token)) && atoi(token) == width;
+	bOk = bOk && read_token(pFile, token, sizeof(token)) && atoi(token) == height;
+
+	frame.assign(width * height / 8, 0);
+	for(int y = 0; bOk && y < height; ++y)
+	{
+		int byte = 0;                                        // P4 rows are packed by 8 pixels, MSB first
+		for(int x = 0; bOk && x < width; ++x)
+		{
+			int pixel;
+			if('4' == magic[1])
+			{
+				if(!(x & 7) && EOF == (byte = fgetc(pFile)))
+					bOk = false;
+				pixel = (byte >> (7 - (x & 7))) & 1;
+			}
+			else
+			{
+				int ch = fgetc(pFile);
+				while(' ' == ch || '\t' == ch || '\r' == ch || '\n' == ch)
+					ch = fgetc(pFile);
+				bOk = '0' == ch || '1' == ch;
+				pixel = '1' == ch;
+			}
+			if(pixel != bInvert)
+				frame[(y / 8) * width + x] |= 1 << (y & 7);
+		}
+	}
+	fclose(pFile);
+
+	return bOk;
+}
+
+// Runs of the frame bytes: repeated bytes go as one byte, the rest as literal runs
+static void encode_runs(const Bytes &data, Bytes &out)
+{
+	size_t pos = 0;
+
+	while(pos < data.size())
+	{
+		size_t repeat = 1;
+		while(pos + repeat < data.size() && repeat < MAX_RUN && data[pos + repeat] == data[pos])
+			++repeat;
+		if(repeat >= MIN_REPEAT)
+		{
+			out.push_back(FRAME_RUN_REPEAT | (repeat - 1));
+			out.push_back(data[pos]);
+			pos += repeat;
+			continue;
+		}
+
+		size_t literal = 0;                                  // Literal run goes until the next long enough repeat
+		while(pos + literal < data.size() && literal < MAX_RUN)
+		{
+			size_t next = pos + literal, same = 1;
+			while(next + same < data.size() && same < MIN_REPEAT && data[next + same] == data[next])
+				++same;
+			if(same >= MIN_REPEAT)
+				break;
+			++literal;
+		}
+		out.push_back(literal - 1);
+		out.insert(out.end(), data.begin() + pos, data.begin() + pos + literal);
+		pos += literal;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int width = 128, height = 64, arg = 1;
+	bool bInvert = false;
+
+	for( ; arg < argc && '-' == argv[arg][0]; ++arg)
+	{
+		if(!strcmp(argv[arg], "-i"))
+			bInvert = true;
+		else if(!strcmp(argv[arg], "-s") && arg + 1 < argc && 2 == sscanf(argv[arg + 1], "%dx%d", &width, &height))
+			++arg;
+		else
+			break;
+	}
+	if(argc - arg < 3 || width < 1 || width > 128 || height < 8 || height > 64 || height % 8)
+	{
+		fprintf(stderr, "Usage: %s [-i] [-s WxH] <array name> <output.cpp> frame1.pbm [frame2.pbm ...]\n", argv[0]);
+		return 1;
+	}
+
+	const char *pName = argv[arg], *pOutName = argv[arg + 1];
+	Bytes stream, previous, frame;
+	size_t keyFrames = 0;
+	for(int i = arg + 2; i < argc; ++i)
+	{
+		if(!read_pbm(argv[i], width, height, bInvert, frame))
+		{
+			fprintf(stderr, "Can't read %s as a %dx%d PBM image\n", argv[i], width, height);
+			return 1;
+		}
+
+		Bytes key(1, 0), delta(1, FRAME_DELTA);
+		encode_runs(frame, key);
+		if(!previous.empty())
+		{
+			Bytes difference(frame.size());
+			for(size_t j = 0; j < frame.size(); ++j)
+				difference[j] = frame[j] ^ previous[j];
+			encode_runs(difference, delta);
+		}
+		bool bKey = previous.empty() || key.size() <= delta.size();
+		keyFrames += bKey;
+		stream.insert(stream.end(), bKey ? key.begin() : delta.begin(), bKey ? key.end() : delta.end());
+		previous = frame;
+	}
+	stream.push_back(FRAME_END);
+
+	FILE *pFile = fopen(pOutName, "w");
+	if(!pFile)
+	{
+		fprintf(stderr, "Can't write %s\n", pOutName);
+		return 1;
+	}
+	fprintf(pFile, "/*\n * Generated by tools/ssd1306_animenc.cpp, do not edit\n *\n");
+	fprintf(pFile, " * %d frames %dx%d (%zu key frames), %zu bytes instead of %zu raw\n */\n\n", argc - arg - 2, width, height,
+	        keyFrames, stream.size(), (size_t)(argc - arg - 2) * frame.size());
+	fprintf(pFile, "#include <stdint.h>\n\nextern const uint8_t %s[];\nconst uint8_t %s[] =\n{", pName, pName);
+	for(size_t i = 0; i < stream.size(); ++i)
+		fprintf(pFile, "%s0x%02X,", i % 16 ? " " : "\n\t", stream[i]);
+	fprintf(pFile, "\n};\n");
+
+	return fclose(pFile) ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * ssd1306_fontconv.cpp
+ *
+ * Host tool converting FontDef tables of fonts.h into PageFontDef tables for SSD1306_oled::write_char().
+ * Build it on the PC together with the font tables of the project, e.g.
+ *   g++ -I.. -I<fonts dir> ssd1306_fontconv.cpp <fonts dir>/fonts.c -o ssd1306_fontconv
+ * and run ./ssd1306_fontconv page_fonts to get page_fonts.h and page_fonts.cpp for the firmware.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fonts.h"
+
+static const uint8_t FIRST_CHAR = 32;
+static const uint8_t CHARS_COUNT = 95;                   // Chars 32...126, same as FontDef tables
+
+struct FontToConvert
+{
+	const FontDef *m_pFont;
+	const char *m_pName;
+};
+
+static const FontToConvert FONTS[] = {{&Font_7x10, "7x10"}, {&Font_11x18, "11x18"}, {&Font_16x26, "16x26"}};
+static const uint8_t FONTS_COUNT = sizeof(FONTS) / sizeof(FONTS[0]);
+
+// Column byte of the glyph page. FontDef glyph is m_Height rows of 16 bits, the leftmost column is bit 15
+static uint8_t page_byte(const FontDef &Font, uint8_t ch, uint8_t page, uint8_t col)
+{
+	uint8_t byte = 0;
+
+	for(uint8_t bit = 0; bit < 8; ++bit)
+	{
+		uint8_t row = page * 8 + bit;
+		if(row < Font.m_Height && ((Font.m_pData[(ch - FIRST_CHAR) * Font.m_Height + row] << col) & 0x8000))
+			byte |= 1 << bit;
+	}
+
+	return byte;
+}
+
+// File name without directories
+static const char *base_name(const char *pPath)
+{
+	const char *pName = strrchr(pPath, '/');
+
+	return pName ? pName + 1 : pPath;
+}
+
+static bool write_header(const char *pBaseName)
+{
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "%s.h", pBaseName);
+	FILE *pFile = fopen(fileName, "w");
+	if(!pFile)
+		return false;
+
+	fprintf(pFile, "/*\n * %s.h\n *\n * Generated by tools/ssd1306_fontconv.cpp, do not edit\n */\n\n", base_name(pBaseName));
+	fprintf(pFile, "#ifndef SSD1306_PAGE_FONTS_H_\n#define SSD1306_PAGE_FONTS_H_\n\n#include \"ssd1306.h\"\n\n");
+	for(uint8_t font = 0; font < FONTS_COUNT; ++font)
+		fprintf(pFile, "extern PageFontDef PageFont_%s;\n", FONTS[font].m_pName);
+	fprintf(pFile, "\n#endif /* SSD1306_PAGE_FONTS_H_ */\n");
+
+	return !fclose(pFile);
+}
+
+static bool write_source(const char *pBaseName)
+{
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "%s.cpp", pBaseName);
+	FILE *pFile = fopen(fileName, "w");
+	if(!pFile)
+		return false;
+
+	fprintf(pFile, "/*\n * %s.cpp\n *\n * Generated by tools/ssd1306_fontconv.cpp, do not edit\n */\n\n", base_name(pBaseName));
+	fprintf(pFile, "#include \"%s.h\"\n", base_name(pBaseName));
+	for(uint8_t font = 0; font < FONTS_COUNT; ++font)
+	{
+		const FontDef &Font = *FONTS[font].m_pFont;
+		uint8_t pages = (Font.m_Height + 7) / 8;
+
+		fprintf(pFile, "\nstatic const uint8_t Font_%s_Pages[] =\n{\n", FONTS[font].m_pName);
+		for(uint16_t ch = FIRST_CHAR; ch < FIRST_CHAR + CHARS_COUNT; ++ch)
+		{
+			fprintf(pFile, "\t");
+			for(uint8_t page = 0; page < pages; ++page)
+			{
+				for(uint8_t col = 0; col < Font.m_Width; ++col)
+					fprintf(pFile, "0x%02X, ", page_byte(Font, ch, page, col));
+			}
+			fprintf(pFile, "// '%c'\n", ch == '\\' ? '/' : ch);
+		}
+		fprintf(pFile, "};\n\nPageFontDef PageFont_%s = {%u, %u, Font_%s_Pages};\n", FONTS[font].m_pName, Font.m_Width,
+		        Font.m_Height, FONTS[font].m_pName);
+	}
+
+	return !fclose(pFile);
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <output base name>\n", argv[0]);
+		return 1;
+	}
+
+	if(!write_header(argv[1]) || !write_source(argv[1]))
+	{
+		fprintf(stderr, "Can't write %s.h or %s.cpp\n", argv[1], argv[1]);
+		return 1;
+	}
+
+	return 0;
+}